@@ -0,0 +1,65 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "messagetokenizer.h"
+
+// The tokenizer the server used before messagetokenizer.h, kept as a baseline
+std::vector<std::string> splitMessage(const std::string& msg, char delimiter)
+{
+    std::stringstream ss(msg);
+    std::string segment;
+    std::vector<std::string> segments;
+    while (std::getline(ss, segment, delimiter))
+    {
+        segments.push_back(segment);
+    }
+    return segments;
+}
+
+template <typename Function>
+void runBenchmark(const std::string& name, const std::vector<std::string>& messages, int iterations, Function function)
+{
+    std::size_t checksum = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (const auto& message : messages)
+        {
+            checksum += function(message);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    double total = static_cast<double>(iterations) * messages.size();
+    double nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / total;
+    std::cout << name << ": " << nanos << " ns/message (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 200000;
+
+    std::vector<std::string> messages = {
+        "eCommerce?>User1>browseProducts>secret",
+        "eCommerce?>User1>addToCart>secret>7>2",
+        "eCommerce?>SomeoneWithALongerUsername>removeItemFromCart>correct horse battery staple>10>1",
+        "eCommerce?>User42>addToWishlist>secret>3",
+        "eCommerce?>User42>viewOrders>secret"
+    };
+
+    std::cout << "Tokenizing " << messages.size() << " messages " << iterations << " times" << std::endl;
+
+    runBenchmark("splitMessage (stringstream)", messages, iterations, [](const std::string& message) {
+        auto segments = splitMessage(message, '>');
+        return segments.size() + segments.back().size();
+    });
+
+    runBenchmark("tokenizeMessage (string_view)", messages, iterations, [](const std::string& message) {
+        auto segments = tokenizeMessage(message, '>');
+        return segments.size() + segments[segments.size() - 1].size();
+    });
+
+    return 0;
+}
@@ -0,0 +1,16 @@
+TEMPLATE = app
+CONFIG += console c++17
+CONFIG -= app_bundle
+CONFIG -= qt
+
+DEFINES += ZMQ_STATIC
+LIBS += -L$$PWD/../lib -lzmq
+win32: LIBS += -lws2_32 -lIphlpapi
+INCLUDEPATH += $$PWD/../include
+
+SOURCES += \
+    broker.cpp \
+    main.cpp
+
+HEADERS += \
+    broker.h
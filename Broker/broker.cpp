@@ -0,0 +1,79 @@
+#include "broker.h"
+#include <atomic>
+
+namespace {
+
+// Queue limit per socket; far above the default of 1000 so a load test
+// measures the server instead of messages dropped by the broker
+constexpr int HighWaterMark = 1000000;
+
+std::string controlEndpoint()
+{
+    static std::atomic<int> brokers{0};
+    return "inproc://broker-control-" + std::to_string(brokers++);
+}
+
+} // namespace
+
+/**
+ * @brief Binds the broker's sockets.
+ *
+ * @throws zmq::error_t if an endpoint cannot be bound.
+ */
+Broker::Broker(zmq::context_t& context, const std::string& pullEndpoint, const std::string& publishEndpoint)
+    : puller(context, ZMQ_PULL), publisher(context, ZMQ_PUB),
+      controlReceiver(context, ZMQ_PAIR), controlSender(context, ZMQ_PAIR)
+{
+    puller.set(zmq::sockopt::rcvhwm, HighWaterMark);
+    publisher.set(zmq::sockopt::sndhwm, HighWaterMark);
+    puller.bind(pullEndpoint);
+    publisher.bind(publishEndpoint);
+
+    std::string control = controlEndpoint();
+    controlReceiver.bind(control);
+    controlSender.connect(control);
+}
+
+Broker::~Broker()
+{
+    stop();
+}
+
+/**
+ * @brief Runs the broker on its own thread until stop() is called.
+ */
+void Broker::start()
+{
+    thread = std::thread(&Broker::run, this);
+}
+
+/**
+ * @brief Forwards messages on the calling thread until stop() is called.
+ */
+void Broker::run()
+{
+    try
+    {
+        zmq::proxy_steerable(puller, publisher, zmq::socket_ref(), controlReceiver);
+    }
+    catch (zmq::error_t&)
+    {
+        // The context was shut down underneath the proxy
+    }
+}
+
+void Broker::stop()
+{
+    if (controlSender) {
+        try
+        {
+            controlSender.send(zmq::str_buffer("TERMINATE"), zmq::send_flags::dontwait);
+        }
+        catch (zmq::error_t&)
+        {
+        }
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
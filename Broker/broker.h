@@ -0,0 +1,36 @@
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <string>
+#include <thread>
+#include <zmq.hpp>
+
+/**
+ * @brief Stand-in for the benternet broker.
+ *
+ * Everything pushed to the pull endpoint is re-published unchanged on the
+ * publish endpoint, where subscribers filter it by topic, just like
+ * benternet does on ports 24041 and 24042. Endpoints can use any transport
+ * ZeroMQ knows; inproc endpoints only reach sockets of the same context,
+ * which is what the server's embedded broker is for.
+ */
+class Broker {
+public:
+    Broker(zmq::context_t& context, const std::string& pullEndpoint, const std::string& publishEndpoint);
+    ~Broker();
+    Broker(const Broker&) = delete;
+    Broker& operator=(const Broker&) = delete;
+
+    void start();
+    void run();
+    void stop();
+
+private:
+    zmq::socket_t puller;
+    zmq::socket_t publisher;
+    zmq::socket_t controlReceiver;
+    zmq::socket_t controlSender;
+    std::thread thread;
+};
+
+#endif // BROKER_H
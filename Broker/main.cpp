@@ -0,0 +1,44 @@
+#include <iostream>
+#include <string>
+#include <zmq.hpp>
+#include "broker.h"
+
+void printUsage()
+{
+    std::cout << "Usage: Broker [--pull <endpoint>] [--publish <endpoint>]\n"
+                 "Forwards every message pushed to the pull endpoint (default tcp://*:24041)\n"
+                 "to all subscribers of the publish endpoint (default tcp://*:24042).\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::string pullEndpoint = "tcp://*:24041";
+    std::string publishEndpoint = "tcp://*:24042";
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "--pull" && i + 1 < argc) {
+            pullEndpoint = argv[++i];
+        } else if (option == "--publish" && i + 1 < argc) {
+            publishEndpoint = argv[++i];
+        } else {
+            printUsage();
+            return option == "--help" ? 0 : 1;
+        }
+    }
+
+    try
+    {
+        zmq::context_t context(1);
+        Broker broker(context, pullEndpoint, publishEndpoint);
+        std::cout << "Forwarding " << pullEndpoint << " to " << publishEndpoint << std::endl;
+        broker.run();
+    }
+    catch (zmq::error_t& ex)
+    {
+        std::cerr << "Caught an exception: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+QT = core
+
+CONFIG += c++17 cmdline
+
+INCLUDEPATH += $$PWD/../eCommerce
+
+SOURCES += \
+        main.cpp \
+        ../eCommerce/productcatalog.cpp
+
+HEADERS += \
+    ../eCommerce/catalogformat.h \
+    ../eCommerce/money.h \
+    ../eCommerce/productcatalog.h
@@ -0,0 +1,123 @@
+// Converts a CSV product list into the binary catalog the eCommerce server maps.
+//
+// Input lines are "id,name,price" with prices such as 49.99; names may be
+// quoted ("...") to contain commas, with "" standing for a literal quote. A
+// first line that does not start with a number is treated as a header and
+// skipped.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include "money.h"
+#include "productcatalog.h"
+
+struct CsvProduct
+{
+    int id;
+    std::string name;
+    std::int64_t priceCents;
+};
+
+std::vector<std::string> splitCsvLine(const std::string& line)
+{
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (std::size_t i = 0; i < line.size(); ++i)
+    {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                ++i;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                fields.back() += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.emplace_back();
+        } else if (c != '\r') {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+std::vector<CsvProduct> readCsv(const std::string& path)
+{
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    std::vector<CsvProduct> products;
+    std::string line;
+    std::size_t lineNumber = 0;
+    while (std::getline(input, line))
+    {
+        ++lineNumber;
+        if (line.empty() || line == "\r") {
+            continue;
+        }
+        auto fields = splitCsvLine(line);
+        if (lineNumber == 1 && (fields[0].empty() || !std::isdigit(static_cast<unsigned char>(fields[0][0])))) {
+            continue;
+        }
+        if (fields.size() != 3) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": expected id,name,price");
+        }
+        try
+        {
+            products.push_back({ std::stoi(fields[0]), fields[1], Money::parseCents(fields[2]) });
+        }
+        catch (const std::exception&)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": invalid id or price");
+        }
+    }
+    return products;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <products.csv> <catalog.bin>" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        std::vector<CsvProduct> products = readCsv(argv[1]);
+        if (products.empty()) {
+            throw std::runtime_error(std::string(argv[1]) + " contains no products");
+        }
+        std::sort(products.begin(), products.end(), [](const CsvProduct& a, const CsvProduct& b) { return a.id < b.id; });
+
+        std::size_t nameBytes = 0;
+        for (const auto& product : products) {
+            nameBytes += product.name.size();
+        }
+
+        ProductCatalog catalog;
+        catalog.reserve(products.back().id, nameBytes);
+        for (const auto& product : products) {
+            catalog.add(product.id, product.name, product.priceCents);
+        }
+        catalog.save(argv[2]);
+
+        std::cout << "Wrote " << catalog.size() << " products to " << argv[2] << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Caught an exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,6 +1,10 @@
 #include <iostream>
+#include <set>
+#include <sstream>
 #include <string>
 #include <zmq.hpp>
+#include "binaryprotocol.h"
+#include "sessiontoken.h"
 #ifndef _WIN32
 #include <unistd.h>
 #else
@@ -8,8 +12,152 @@
 #define sleep(n)    Sleep(n)
 #endif
 
-int main()
+/**
+ * @brief Waits up to a second for a message and returns it, or an empty string.
+ */
+std::string receiveWithTimeout(zmq::socket_t& subscriber)
 {
+    zmq::pollitem_t items[] = { { static_cast<void*>(subscriber), 0, ZMQ_POLLIN, 0 } };
+    zmq::poll(items, 1, std::chrono::milliseconds(1000));
+    zmq::message_t message;
+    if (!(items[0].revents & ZMQ_POLLIN) || !subscriber.recv(message, zmq::recv_flags::none)) {
+        return std::string();
+    }
+    return message.to_string();
+}
+
+/**
+ * @brief Logs in with start>binary and then sends commands typed as "<command> <arguments>" in binary.
+ */
+int runBinary(zmq::socket_t& ventilator, zmq::socket_t& subscriber, const std::string& username, const std::string& password)
+{
+    std::string startTopic = "eCommerce!>" + username + ">start>";
+    subscriber.set(zmq::sockopt::subscribe, startTopic);
+    std::string start = "eCommerce?>" + username + ">start>" + password + ">" + std::string(BinaryProtocol::StartOption);
+    ventilator.send(zmq::buffer(start), zmq::send_flags::none);
+
+    std::string reply = receiveWithTimeout(subscriber);
+    std::uint32_t user;
+    std::uint64_t secret;
+    if (!SessionToken::parse(reply.substr(reply.rfind('>') + 1), user, secret)) {
+        std::cerr << "No session token received for " << username << "." << std::endl;
+        return 1;
+    }
+    subscriber.set(zmq::sockopt::unsubscribe, startTopic);
+    subscriber.set(zmq::sockopt::subscribe, BinaryProtocol::responseTopic(user));
+    subscriber.set(zmq::sockopt::subscribe, BinaryProtocol::responseTopic(BinaryProtocol::BroadcastUser));
+    std::cout << "Logged in as user " << user << " using the binary protocol." << std::endl;
+
+    // Catalog from the broadcasts, so browseProducts only has to confirm its version
+    std::uint64_t catalogVersion = 0;
+    std::string catalogText;
+
+    std::string input;
+    while (true)
+    {
+        std::cout << "Enter command to send: ";
+        std::getline(std::cin, input);
+        if (input.empty())
+        {
+            std::cout << "Empty input, exiting." << std::endl;
+            break;
+        }
+
+        std::istringstream words(input);
+        std::string name;
+        words >> name;
+        std::uint8_t opcode = BinaryProtocol::opcodeFor(name);
+        if (opcode == 0) {
+            std::cout << "Unknown command: " << name << std::endl;
+            continue;
+        }
+        std::string request;
+        BinaryProtocol::appendRequestHeader(request, user, secret, opcode);
+        std::size_t arguments = 0;
+        std::uint64_t value;
+        while (words >> value) {
+            BinaryProtocol::putVarint(request, value);
+            ++arguments;
+        }
+        if (opcode == BinaryProtocol::BrowseProducts && arguments == 0) {
+            BinaryProtocol::putVarint(request, catalogVersion);
+            ++arguments;
+        }
+        if (arguments != BinaryProtocol::command(opcode)->arguments) {
+            std::cout << name << " takes " << BinaryProtocol::command(opcode)->arguments << " numeric arguments." << std::endl;
+            continue;
+        }
+        ventilator.send(zmq::buffer(request), zmq::send_flags::none);
+        std::cout << "Pushed " << request.size() << " bytes." << std::endl;
+
+        while (true)
+        {
+            std::string response = receiveWithTimeout(subscriber);
+            std::string_view payload(response);
+            std::uint32_t responseUser;
+            std::uint8_t responseOpcode;
+            BinaryProtocol::Status status;
+            if (!BinaryProtocol::parseResponseHeader(payload, responseUser, responseOpcode, status)) {
+                std::cout << "No response received within 1 second, continuing." << std::endl;
+                break;
+            }
+
+            std::string text = BinaryProtocol::describe(responseOpcode, status, payload);
+            if (responseOpcode == BinaryProtocol::BrowseProducts && status == BinaryProtocol::Ok) {
+                std::string_view products = payload;
+                std::uint64_t version = 0;
+                BinaryProtocol::getVarint(products, version);
+                if (!products.empty()) {
+                    catalogVersion = version;
+                    catalogText = text;
+                } else if (version == catalogVersion) {
+                    text += "\n" + catalogText;
+                }
+            }
+            if (responseUser == BinaryProtocol::BroadcastUser) {
+                std::cout << "Catalog version " << catalogVersion << " received and cached." << std::endl;
+                continue;
+            }
+            std::cout << "Received " << response.size() << " bytes:\n" << text << std::endl;
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Subscribes to the responses for the user a typed message is sent as.
+ *
+ * Responses are published on "eCommerce!>username>", so only the traffic
+ * of users this console has sent for reaches it.
+ */
+void subscribeToSender(zmq::socket_t& subscriber, std::set<std::string>& subscribed, const std::string& message)
+{
+    std::size_t userStart = message.find('>');
+    if (userStart == std::string::npos) {
+        return;
+    }
+    ++userStart;
+    std::string username = message.substr(userStart, message.find('>', userStart) - userStart);
+    if (!username.empty() && subscribed.insert(username).second) {
+        subscriber.set(zmq::sockopt::subscribe, "eCommerce!>" + username + ">");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // Usage: ConsoleClient [--binary <username> <password>] [push endpoint] [sub endpoint]
+    int arg = 1;
+    std::string username, password;
+    bool binary = argc > 3 && std::string(argv[1]) == "--binary";
+    if (binary) {
+        username = argv[2];
+        password = argv[3];
+        arg = 4;
+    }
+    std::string pushEndpoint = argc > arg ? argv[arg] : "tcp://benternet.pxl-ea-ict.be:24041";
+    std::string subscribeEndpoint = argc > arg + 1 ? argv[arg + 1] : "tcp://benternet.pxl-ea-ict.be:24042";
+
     try
     {
         // Create the ZMQ context with a single IO thread
@@ -17,12 +165,15 @@ int main()
 
         // Initialize a push socket (ventilator)
         zmq::socket_t ventilator(context, ZMQ_PUSH);
-        ventilator.connect("tcp://benternet.pxl-ea-ict.be:24041");
+        ventilator.connect(pushEndpoint);
 
         // Initialize a subscriber socket
         zmq::socket_t subscriber(context, ZMQ_SUB);
-        subscriber.connect("tcp://benternet.pxl-ea-ict.be:24042");  // Adjust the address as needed
-        subscriber.setsockopt(ZMQ_SUBSCRIBE, "eCommerce!>", 11);    // Subscribe to the topic "eCommerce!>"
+        subscriber.connect(subscribeEndpoint);
+        if (binary) {
+            return runBinary(ventilator, subscriber, username, password);
+        }
+        std::set<std::string> subscribed;
 
         std::string input;
         while (true)
@@ -35,6 +186,8 @@ int main()
                 break;
             }
 
+            subscribeToSender(subscriber, subscribed, input);
+
             // Send message to the ventilator
             zmq::message_t message(input.size());
             memcpy(message.data(), input.data(), input.size());
@@ -1,10 +1,11 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++17
 CONFIG -= app_bundle
 CONFIG -= qt
 
 DEFINES += ZMQ_STATIC
-LIBS += -L$$PWD/../lib -lzmq -lws2_32 -lIphlpapi
-INCLUDEPATH += $$PWD/../include
+LIBS += -L$$PWD/../lib -lzmq
+win32: LIBS += -lws2_32 -lIphlpapi
+INCLUDEPATH += $$PWD/../include $$PWD/../eCommerce
 
 SOURCES += main.cpp
@@ -1,90 +1,348 @@
 #include <iostream>
 #include <zmq.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
-#include <random>
+#include "latencyhistogram.h"
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Settings of a load run, taken from the command line.
+ */
+struct LoadConfig {
+    std::string pushEndpoint = "tcp://benternet.pxl-ea-ict.be:24041";
+    std::string subEndpoint = "tcp://benternet.pxl-ea-ict.be:24042";
+    double rate = 100.0;                // commands per second over all users
+    int users = 1000;
+    std::chrono::seconds duration{30};
+    std::chrono::seconds drainTimeout{5};
+    bool poisson = true;                // exponential inter-arrival times instead of a fixed interval
+    std::map<std::string, double> mix = {
+        { "browseProducts", 20 },
+        { "addToCart", 35 },
+        { "viewCart", 20 },
+        { "checkout", 8 },
+        { "pay", 5 },
+        { "viewOrders", 7 },
+        { "help", 5 }
+    };
+};
+
+/**
+ * @brief A command sent and not yet answered.
+ *
+ * intended is when the arrival schedule wanted it sent. Measuring from there
+ * rather than from the actual send keeps a stalled generator from hiding
+ * the delay it caused (coordinated omission).
+ */
+struct Outstanding {
+    std::string command;
+    Clock::time_point intended;
+    Clock::time_point sent;
+};
+
+struct SimulatedUser {
+    std::string name;
+    std::string password;
+    bool started = false;
+    std::deque<Outstanding> outstanding;
+};
 
-#ifndef _WIN32
-#include <unistd.h>
-#else
-#include <windows.h>
-#define sleep(n)    Sleep(n)
-#endif
+struct CommandResults {
+    std::unique_ptr<LatencyHistogram> corrected = std::make_unique<LatencyHistogram>();
+    std::unique_ptr<LatencyHistogram> uncorrected = std::make_unique<LatencyHistogram>();
+    std::uint64_t sent = 0;
+    std::uint64_t lost = 0;
+};
 
-void sendCommand(zmq::socket_t& socket, const std::string& command)
+void printUsage()
 {
-    socket.send(zmq::buffer(command), zmq::send_flags::none);
-    std::cout << "Pushed: " << command << std::endl;
-    sleep(1); // Ensure there's a delay between commands
+    std::cout << "Usage: Testrun [--rate <commands/s>] [--users <count>] [--duration <seconds>]\n"
+                 "               [--arrival poisson|constant] [--mix <command>=<weight>,...]\n"
+                 "               [--push <endpoint>] [--sub <endpoint>]\n";
+}
+
+std::map<std::string, double> parseMix(const std::string& text)
+{
+    std::map<std::string, double> mix;
+    std::size_t start = 0;
+    while (start < text.size())
+    {
+        std::size_t end = text.find(',', start);
+        std::string item = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        std::size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            throw std::invalid_argument("Mix entries look like <command>=<weight>: " + item);
+        }
+        mix[item.substr(0, equals)] = std::stod(item.substr(equals + 1));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return mix;
 }
 
-void runTestScenario(zmq::context_t& context, int userId)
+LoadConfig parseArguments(int argc, char* argv[])
 {
-    zmq::socket_t socket(context, ZMQ_PUSH);
-    socket.connect("tcp://benternet.pxl-ea-ict.be:24041");
+    LoadConfig config;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "--help" || i + 1 >= argc) {
+            printUsage();
+            std::exit(option == "--help" ? 0 : 1);
+        }
+        std::string value = argv[++i];
+        if (option == "--rate") {
+            config.rate = std::stod(value);
+        } else if (option == "--users") {
+            config.users = std::stoi(value);
+        } else if (option == "--duration") {
+            config.duration = std::chrono::seconds(std::stoi(value));
+        } else if (option == "--arrival") {
+            config.poisson = value != "constant";
+        } else if (option == "--mix") {
+            config.mix = parseMix(value);
+        } else if (option == "--push") {
+            config.pushEndpoint = value;
+        } else if (option == "--sub") {
+            config.subEndpoint = value;
+        } else {
+            printUsage();
+            std::exit(1);
+        }
+    }
+    if (config.rate <= 0 || config.users <= 0 || config.mix.empty()) {
+        throw std::invalid_argument("Rate, users and the command mix must not be empty or zero.");
+    }
+    return config;
+}
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
+/**
+ * @brief Picks the next command of a user from the command mix.
+ *
+ * A user that has not started yet, or that just stopped, sends start first.
+ */
+std::string nextCommand(SimulatedUser& user, std::mt19937& gen, std::discrete_distribution<>& mixDist,
+                        const std::vector<std::string>& mixCommands, std::string& message)
+{
     std::uniform_int_distribution<> productDist(1, 10);
     std::uniform_int_distribution<> quantityDist(1, 4);
-    std::uniform_int_distribution<> addToCartCountDist(1, 10);
-    std::bernoulli_distribution payDist(0.5);
-
-    int addToCartCount = addToCartCountDist(gen);
 
-    // Initial set of commands
-    std::vector<std::string> commands = {
-        "eCommerce?>User" + std::to_string(userId) + ">start",
-        "eCommerce?>User" + std::to_string(userId) + ">help",
-        "eCommerce?>User" + std::to_string(userId) + ">browseProducts"
-    };
+    std::string command = user.started ? mixCommands[mixDist(gen)] : "start";
+    user.started = command != "stop";
 
-    // Add random addToCart commands
-    for (int i = 0; i < addToCartCount; ++i)
-    {
-        commands.push_back("eCommerce?>User" + std::to_string(userId) + ">addToCart>" + std::to_string(productDist(gen)) + ">" + std::to_string(quantityDist(gen)));
+    message = "eCommerce?>" + user.name + ">" + command + ">" + user.password;
+    if (command == "addToCart" || command == "updateCartItem" || command == "removeItemFromCart") {
+        message += ">" + std::to_string(productDist(gen)) + ">" + std::to_string(quantityDist(gen));
+    } else if (command == "addToWishlist" || command == "removeFromWishlist") {
+        message += ">" + std::to_string(productDist(gen));
+    } else if (command == "searchProducts") {
+        static const char* const queries[] = { "apple", "galaxy", "head", "sony phones", "watch" };
+        std::uniform_int_distribution<std::size_t> queryDist(0, std::size(queries) - 1);
+        message += ">" + std::string(queries[queryDist(gen)]);
+    } else if (command == "suggest") {
+        static const char* const prefixes[] = { "a", "ap", "sam", "son", "s" };
+        std::uniform_int_distribution<std::size_t> prefixDist(0, std::size(prefixes) - 1);
+        message += ">" + std::string(prefixes[prefixDist(gen)]);
     }
+    return command;
+}
 
-    // Remaining set of commands
-    commands.push_back("eCommerce?>User" + std::to_string(userId) + ">viewCart");
-    commands.push_back("eCommerce?>User" + std::to_string(userId) + ">checkout");
+/**
+ * @brief Matches a response to the oldest outstanding command of its user.
+ *
+ * A user's commands are handled in order, so anything older than the
+ * answered command will not be answered any more and counts as lost.
+ *
+ * @return The number of outstanding commands resolved, answered or lost.
+ */
+std::size_t handleResponse(std::string_view response, std::map<std::string, SimulatedUser*, std::less<>>& usersByName,
+                           std::map<std::string, CommandResults>& results, Clock::time_point now, std::uint64_t& received)
+{
+    // eCommerce!>user>command>password>message
+    std::size_t userStart = response.find('>');
+    std::size_t userEnd = userStart == std::string_view::npos ? userStart : response.find('>', userStart + 1);
+    std::size_t commandEnd = userEnd == std::string_view::npos ? userEnd : response.find('>', userEnd + 1);
+    if (commandEnd == std::string_view::npos) {
+        return 0;
+    }
+    auto user = usersByName.find(response.substr(userStart + 1, userEnd - userStart - 1));
+    if (user == usersByName.end()) {
+        return 0;
+    }
+    std::string_view command = response.substr(userEnd + 1, commandEnd - userEnd - 1);
 
-    // 50/50 chance to add the pay command
-    if (payDist(gen)) {
-        commands.push_back("eCommerce?>User" + std::to_string(userId) + ">pay");
+    std::deque<Outstanding>& outstanding = user->second->outstanding;
+    std::size_t resolved = 0;
+    while (!outstanding.empty())
+    {
+        Outstanding request = std::move(outstanding.front());
+        outstanding.pop_front();
+        ++resolved;
+        CommandResults& result = results[request.command];
+        if (request.command != command) {
+            ++result.lost;
+            continue;
+        }
+        result.corrected->record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request.intended).count());
+        result.uncorrected->record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request.sent).count());
+        ++received;
+        break;
     }
+    return resolved;
+}
 
-    commands.push_back("eCommerce?>User" + std::to_string(userId) + ">viewOrders");
-    commands.push_back("eCommerce?>User" + std::to_string(userId) + ">stop");
+void printRow(const char* name, const LatencyHistogram::Counts& counts, std::uint64_t sent, std::uint64_t lost)
+{
+    auto millis = [](std::uint64_t nanos) { return static_cast<double>(nanos) / 1e6; };
+    std::printf("%-20s %9llu %9llu %9llu %9.2f %9.2f %9.2f %9.2f %9.2f\n", name,
+                static_cast<unsigned long long>(sent), static_cast<unsigned long long>(counts.total),
+                static_cast<unsigned long long>(lost),
+                millis(counts.percentile(0.5)), millis(counts.percentile(0.9)), millis(counts.percentile(0.99)),
+                millis(counts.percentile(0.999)), millis(counts.max()));
+}
 
-    for (const auto& command : commands)
+void printReport(std::map<std::string, CommandResults>& results, std::chrono::duration<double> elapsed, std::uint64_t received)
+{
+    std::printf("\n%llu responses in %.1f s: %.1f responses/s\n",
+                static_cast<unsigned long long>(received), elapsed.count(), received / elapsed.count());
+
+    for (bool corrected : { true, false })
     {
-        sendCommand(socket, command);
+        std::printf("\nLatency in ms, %s:\n", corrected ? "from the intended send time (corrected for coordinated omission)"
+                                                        : "from the actual send time (uncorrected)");
+        std::printf("%-20s %9s %9s %9s %9s %9s %9s %9s %9s\n", "command", "sent", "answered", "lost", "p50", "p90", "p99", "p99.9", "max");
+        LatencyHistogram::Counts all;
+        std::uint64_t allSent = 0;
+        std::uint64_t allLost = 0;
+        for (auto& [command, result] : results)
+        {
+            LatencyHistogram::Counts counts;
+            (corrected ? result.corrected : result.uncorrected)->mergeInto(counts);
+            (corrected ? result.corrected : result.uncorrected)->mergeInto(all);
+            allSent += result.sent;
+            allLost += result.lost;
+            printRow(command.c_str(), counts, result.sent, result.lost);
+        }
+        printRow("all", all, allSent, allLost);
     }
 }
 
-int main(void)
+int main(int argc, char* argv[])
 {
     try
     {
+        LoadConfig config = parseArguments(argc, argv);
+
         zmq::context_t context(1);
-        std::vector<std::thread> threads;
+        zmq::socket_t pusher(context, ZMQ_PUSH);
+        pusher.connect(config.pushEndpoint);
+        zmq::socket_t subscriber(context, ZMQ_SUB);
+        subscriber.connect(config.subEndpoint);
+        subscriber.set(zmq::sockopt::subscribe, "eCommerce!>");
 
-        // Create and run test scenarios for 5 users
-        for (int i = 1; i <= 5; ++i)
-        {
-            threads.emplace_back(runTestScenario, std::ref(context), i);
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::vector<std::string> mixCommands;
+        std::vector<double> mixWeights;
+        for (const auto& [command, weight] : config.mix) {
+            mixCommands.push_back(command);
+            mixWeights.push_back(weight);
         }
+        std::discrete_distribution<> mixDist(mixWeights.begin(), mixWeights.end());
+        std::uniform_int_distribution<> userDist(0, config.users - 1);
+        std::exponential_distribution<> gapDist(config.rate);
 
-        // Join all threads
-        for (auto& thread : threads)
+        std::vector<SimulatedUser> users(config.users);
+        std::map<std::string, SimulatedUser*, std::less<>> usersByName;
+        std::uint32_t runId = static_cast<std::uint32_t>(rd());
+        for (int i = 0; i < config.users; ++i) {
+            // A run id keeps users apart from those of earlier runs on the same server
+            users[i].name = "Load" + std::to_string(runId) + "-" + std::to_string(i);
+            users[i].password = "pw" + std::to_string(i);
+            usersByName[users[i].name] = &users[i];
+        }
+
+        // Give the subscription time to reach the broker before the first command
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        std::cout << "Sending " << config.rate << " commands/s from " << config.users << " users for "
+                  << config.duration.count() << " s (" << (config.poisson ? "poisson" : "constant") << " arrivals)" << std::endl;
+
+        std::map<std::string, CommandResults> results;
+        std::uint64_t received = 0;
+        std::uint64_t outstandingCount = 0;
+        zmq::pollitem_t items[] = { { static_cast<void*>(subscriber), 0, ZMQ_POLLIN, 0 } };
+
+        Clock::time_point start = Clock::now();
+        Clock::time_point sendEnd = start + config.duration;
+        Clock::time_point nextSend = start;
+        Clock::time_point deadline = sendEnd + config.drainTimeout;
+        std::string message;
+        while (true)
         {
-            thread.join();
+            Clock::time_point now = Clock::now();
+
+            // Open loop: everything whose arrival time has passed goes out now,
+            // however many responses are still missing
+            while (nextSend <= now && nextSend < sendEnd)
+            {
+                SimulatedUser& user = users[userDist(gen)];
+                std::string command = nextCommand(user, gen, mixDist, mixCommands, message);
+                pusher.send(zmq::buffer(message), zmq::send_flags::none);
+                user.outstanding.push_back({ command, nextSend, Clock::now() });
+                ++results[command].sent;
+                ++outstandingCount;
+
+                double gap = config.poisson ? gapDist(gen) : 1.0 / config.rate;
+                nextSend += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap));
+            }
+            if (now >= deadline || (now >= sendEnd && outstandingCount == 0)) {
+                break;
+            }
+
+            Clock::time_point wakeup = nextSend < sendEnd ? nextSend : deadline;
+            auto timeout = std::chrono::ceil<std::chrono::milliseconds>(wakeup - now);
+            zmq::poll(items, 1, timeout);
+
+            zmq::message_t response;
+            while (subscriber.recv(response, zmq::recv_flags::dontwait))
+            {
+                outstandingCount -= handleResponse(std::string_view(response.data<char>(), response.size()),
+                                                   usersByName, results, Clock::now(), received);
+            }
+        }
+
+        // Whatever is still outstanding never got an answer
+        for (SimulatedUser& user : users) {
+            for (const Outstanding& request : user.outstanding) {
+                ++results[request.command].lost;
+            }
         }
+        printReport(results, Clock::now() - start, received);
     }
-    catch (zmq::error_t & ex)
+    catch (zmq::error_t& ex)
     {
         std::cerr << "Caught an exception: " << ex.what() << std::endl;
+        return 1;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
 
     return 0;
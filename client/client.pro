@@ -9,8 +9,9 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 DEFINES += ZMQ_STATIC
-LIBS += -L$$PWD/../lib -lzmq -lws2_32 -lIphlpapi
-INCLUDEPATH += $$PWD/../include
+LIBS += -L$$PWD/../lib -lzmq
+win32: LIBS += -lws2_32 -lIphlpapi
+INCLUDEPATH += $$PWD/../include $$PWD/../eCommerce
 
 
 SOURCES += \
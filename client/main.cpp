@@ -1,11 +1,31 @@
 #include "mainwindow.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
-    MainWindow w;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("eCommerce client");
+    parser.addHelpOption();
+    QCommandLineOption pushOption("push",
+                                  "Broker endpoint commands are pushed to.",
+                                  "endpoint",
+                                  "tcp://benternet.pxl-ea-ict.be:24041");
+    QCommandLineOption subOption("sub",
+                                 "Broker endpoint responses are subscribed from.",
+                                 "endpoint",
+                                 "tcp://benternet.pxl-ea-ict.be:24042");
+    QCommandLineOption binaryOption("binary",
+                                    "Use the compact binary protocol after logging in with start.");
+    parser.addOption(pushOption);
+    parser.addOption(subOption);
+    parser.addOption(binaryOption);
+    parser.process(a);
+
+    MainWindow w(parser.value(pushOption).toStdString(), parser.value(subOption).toStdString(), parser.isSet(binaryOption));
     w.show();
     return a.exec();
 }
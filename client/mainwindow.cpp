@@ -1,25 +1,32 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include <QMessageBox>
+#include <QInputDialog>
 #include <QDebug>
+#include <charconv>
+#include "binaryprotocol.h"
+#include "sessiontoken.h"
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(const std::string& pushEndpoint, const std::string& subscribeEndpoint, bool binary, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , context(1)
     , pusher(context, ZMQ_PUSH)
     , subscriber(context, ZMQ_SUB)
     , messageTimer(new QTimer(this))
+    , binary(binary)
 {
     ui->setupUi(this);
 
-    pusher.connect("tcp://benternet.pxl-ea-ict.be:24041");
-    subscriber.connect("tcp://benternet.pxl-ea-ict.be:24042");
+    pusher.connect(pushEndpoint);
+    subscriber.connect(subscribeEndpoint);
 
-    // pusher.connect("tcp://localhost:24041");
-    // subscriber.connect("tcp://localhost:24042");
-
-    subscriber.set(zmq::sockopt::subscribe, "eCommerce!");
+    // Subscriptions are per user, see subscribeToUser(), plus the catalog broadcasts
+    if (binary) {
+        subscriber.set(zmq::sockopt::subscribe, BinaryProtocol::responseTopic(BinaryProtocol::BroadcastUser));
+    } else {
+        subscriber.set(zmq::sockopt::subscribe, "eCommerce!catalog>");
+    }
 
     // Setting up UI signals and slots
     connect(ui->browseProductsButton, &QPushButton::clicked, this, &MainWindow::browseProductsButton_clicked);
@@ -51,6 +58,143 @@ void MainWindow::sendMessage(const std::string& message)
     pusher.send(zmq::buffer(message), zmq::send_flags::none);
 }
 
+/**
+ * @brief Subscribes to the responses for one user only.
+ *
+ * Responses are published on "eCommerce!>username>", so the broker drops
+ * every other user's traffic before it reaches this client.
+ */
+void MainWindow::subscribeToUser(const std::string& username)
+{
+    if (username == subscribedUsername) {
+        return;
+    }
+    if (!subscribedUsername.empty()) {
+        subscriber.set(zmq::sockopt::unsubscribe, "eCommerce!>" + subscribedUsername + ">");
+    }
+    subscriber.set(zmq::sockopt::subscribe, "eCommerce!>" + username + ">");
+    subscribedUsername = username;
+}
+
+void MainWindow::sendCommand(const std::string& username, const std::string& command, std::initializer_list<int> arguments)
+{
+    subscribeToUser(username);
+    if (!binary) {
+        std::string message = "eCommerce?>" + username + ">" + command;
+        for (int argument : arguments) {
+            message += ">" + std::to_string(argument);
+        }
+        sendMessage(message);
+        return;
+    }
+
+    pendingArguments.clear();
+    for (int argument : arguments) {
+        if (argument < 0) {
+            QMessageBox::warning(this, "Error", "Product IDs and quantities cannot be negative");
+            return;
+        }
+        pendingArguments.push_back(static_cast<std::uint64_t>(argument));
+    }
+    if (sessionSecret != 0 && sessionUsername == username) {
+        sendBinaryCommand(command, pendingArguments);
+        return;
+    }
+
+    // Log in first; the command is sent once the session token arrives
+    bool ok = false;
+    QString password = QInputDialog::getText(this, "Log in", "Password for " + QString::fromStdString(username) + ":",
+                                             QLineEdit::Password, QString(), &ok);
+    if (!ok || password.isEmpty()) {
+        return;
+    }
+    if (sessionSecret != 0) {
+        subscriber.set(zmq::sockopt::unsubscribe, BinaryProtocol::responseTopic(sessionUser));
+        sessionSecret = 0;
+    }
+    sessionUsername = username;
+    pendingCommand = command;
+    sendMessage("eCommerce?>" + username + ">start>" + password.toStdString() + ">" + std::string(BinaryProtocol::StartOption));
+}
+
+void MainWindow::sendBinaryCommand(const std::string& command, const std::vector<std::uint64_t>& arguments)
+{
+    std::string request;
+    BinaryProtocol::appendRequestHeader(request, sessionUser, sessionSecret, BinaryProtocol::opcodeFor(command));
+    for (std::uint64_t argument : arguments) {
+        BinaryProtocol::putVarint(request, argument);
+    }
+    qDebug() << "Sending" << request.size() << "byte binary" << QString::fromStdString(command) << "request";
+    pusher.send(zmq::buffer(request), zmq::send_flags::none);
+}
+
+/**
+ * @brief Caches a catalog broadcast on "eCommerce!catalog>version>".
+ *
+ * @return false if the message is not a catalog broadcast.
+ */
+bool MainWindow::handleCatalog(const std::string& message)
+{
+    static const std::string topic = "eCommerce!catalog>";
+    if (message.compare(0, topic.size(), topic) != 0) {
+        return false;
+    }
+    std::size_t versionEnd = message.find('>', topic.size());
+    std::uint64_t version = 0;
+    if (versionEnd != std::string::npos
+        && std::from_chars(message.data() + topic.size(), message.data() + versionEnd, version).ec == std::errc()) {
+        catalogVersion = version;
+        catalogText = QString::fromStdString(message.substr(versionEnd + 1));
+    }
+    return true;
+}
+
+/**
+ * @brief Handles the start>binary reply and binary responses.
+ *
+ * @return false if the message is not part of the binary session.
+ */
+bool MainWindow::handleBinaryMessage(const std::string& message)
+{
+    std::string_view payload(message);
+    std::uint32_t user;
+    std::uint8_t opcode;
+    BinaryProtocol::Status status;
+    if (BinaryProtocol::parseResponseHeader(payload, user, opcode, status)) {
+        QString text = QString::fromStdString(BinaryProtocol::describe(opcode, status, payload));
+        if (opcode == BinaryProtocol::BrowseProducts && status == BinaryProtocol::Ok) {
+            std::string_view products = payload;
+            std::uint64_t version = 0;
+            BinaryProtocol::getVarint(products, version);
+            if (!products.empty()) {
+                catalogVersion = version;
+                catalogText = text;
+            } else if (version == catalogVersion) {
+                text = catalogText;
+            }
+        }
+        if (sessionSecret != 0 && user == sessionUser) {
+            ui->messagesListWidget->addItem(text);
+        }
+        return true;
+    }
+
+    std::string startReply = "eCommerce!>" + sessionUsername + ">start>";
+    if (pendingCommand.empty() || message.compare(0, startReply.size(), startReply) != 0) {
+        return false;
+    }
+    std::uint64_t secret;
+    if (!SessionToken::parse(std::string_view(message).substr(message.rfind('>') + 1), user, secret)) {
+        return false;
+    }
+    sessionUser = user;
+    sessionSecret = secret;
+    subscriber.set(zmq::sockopt::subscribe, BinaryProtocol::responseTopic(sessionUser));
+    sendBinaryCommand(pendingCommand, pendingArguments);
+    pendingCommand.clear();
+    return true;
+}
+
 void MainWindow::browseProductsButton_clicked()
 {
     qDebug() << "Browse Products Button Clicked";
@@ -59,7 +203,15 @@ void MainWindow::browseProductsButton_clicked()
         QMessageBox::warning(this, "Error", "Username cannot be empty");
         return;
     }
-    sendMessage("eCommerce?>" + username + ">browseProducts");
+    if (binary) {
+        // Answered with only the version if the cached catalog is current
+        sendCommand(username, "browseProducts", { static_cast<int>(catalogVersion) });
+    } else if (catalogVersion != 0) {
+        ui->messagesListWidget->addItem(catalogText);
+        ui->messagesListWidget->scrollToBottom();
+    } else {
+        sendCommand(username, "browseProducts");
+    }
 }
 
 void MainWindow::addToCartButton_clicked()
@@ -72,8 +224,7 @@ void MainWindow::addToCartButton_clicked()
     }
     int productId = ui->productIdLineEdit->text().toInt();
     int quantity = ui->quantityLineEdit->text().toInt();
-    std::string message = "eCommerce?>" + username + ">addToCart>" + std::to_string(productId) + ">" + std::to_string(quantity);
-    sendMessage(message);
+    sendCommand(username, "addToCart", { productId, quantity });
 }
 
 void MainWindow::clearCartButton_clicked()
@@ -84,8 +235,7 @@ void MainWindow::clearCartButton_clicked()
         QMessageBox::warning(this, "Error", "Username cannot be empty");
         return;
     }
-    std::string message = "eCommerce?>" + username + ">clearCart";
-    sendMessage(message);
+    sendCommand(username, "clearCart");
 }
 
 void MainWindow::viewCartButton_clicked()
@@ -96,7 +246,7 @@ void MainWindow::viewCartButton_clicked()
         QMessageBox::warning(this, "Error", "Username cannot be empty");
         return;
     }
-    sendMessage("eCommerce?>" + username + ">viewCart");
+    sendCommand(username, "viewCart");
 }
 
 void MainWindow::checkoutButton_clicked()
@@ -107,7 +257,7 @@ void MainWindow::checkoutButton_clicked()
         QMessageBox::warning(this, "Error", "Username cannot be empty");
         return;
     }
-    sendMessage("eCommerce?>" + username + ">checkout");
+    sendCommand(username, "checkout");
 }
 
 void MainWindow::payButton_clicked()
@@ -118,7 +268,7 @@ void MainWindow::payButton_clicked()
         QMessageBox::warning(this, "Error", "Username cannot be empty");
         return;
     }
-    sendMessage("eCommerce?>" + username + ">pay");
+    sendCommand(username, "pay");
 }
 
 void MainWindow::viewOrdersButton_clicked()
@@ -129,7 +279,7 @@ void MainWindow::viewOrdersButton_clicked()
         QMessageBox::warning(this, "Error", "Username cannot be empty");
         return;
     }
-    sendMessage("eCommerce?>" + username + ">viewOrders");
+    sendCommand(username, "viewOrders");
 }
 
 void MainWindow::checkForIncomingMessages()
@@ -140,6 +290,14 @@ void MainWindow::checkForIncomingMessages()
         if (!result) break;
         std::string receivedMsg(static_cast<char*>(msg.data()), msg.size());
 
+        if (handleCatalog(receivedMsg)) {
+            continue;
+        }
+        if (binary && handleBinaryMessage(receivedMsg)) {
+            ui->messagesListWidget->scrollToBottom();
+            continue;
+        }
+
         // Filter out heartbeat messages
         if (receivedMsg.find("heartbeat") != std::string::npos) {
             continue;
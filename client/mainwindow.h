@@ -3,6 +3,9 @@
 
 #include <QMainWindow>
 #include <QTimer>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
 #include <zmq.hpp>
 
 QT_BEGIN_NAMESPACE
@@ -16,7 +19,7 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    MainWindow(const std::string& pushEndpoint, const std::string& subscribeEndpoint, bool binary = false, QWidget *parent = nullptr);
     ~MainWindow();
 
 private slots:
@@ -35,8 +38,24 @@ private:
     zmq::socket_t pusher;
     zmq::socket_t subscriber;
     QTimer *messageTimer;
+    std::string subscribedUsername;
 
+    // Binary protocol session, set up by start>binary before the first command
+    bool binary;
+    std::string sessionUsername;
+    std::uint32_t sessionUser = 0;
+    std::uint64_t sessionSecret = 0;
+    std::uint64_t catalogVersion = 0;   // catalog cached from the broadcasts, 0 if none yet
+    QString catalogText;
+    std::string pendingCommand;
+    std::vector<std::uint64_t> pendingArguments;
+
+    void subscribeToUser(const std::string& username);
     void sendMessage(const std::string& message);
+    void sendCommand(const std::string& username, const std::string& command, std::initializer_list<int> arguments = {});
+    void sendBinaryCommand(const std::string& command, const std::vector<std::uint64_t>& arguments);
+    bool handleBinaryMessage(const std::string& message);
+    bool handleCatalog(const std::string& message);
     std::string receiveMessage();
     std::string getUsername();
 };
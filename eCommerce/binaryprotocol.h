@@ -0,0 +1,320 @@
+#ifndef BINARYPROTOCOL_H
+#define BINARYPROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "money.h"
+
+/**
+ * @brief Compact binary framing, used once a client opted in through start.
+ *
+ * A client that sends start with a fifth segment "binary" gets its bare
+ * session token back and may then send requests as
+ *
+ *     "eCommerce#" | user u32 | secret u64 | opcode u8 | varint arguments
+ *
+ * where user and secret come from the token. Answers are published as
+ *
+ *     "eCommerce$" | user u32 | opcode u8 | status u8 | payload
+ *
+ * so a client subscribes to responseTopic(user) to get only its own. The
+ * catalog is broadcast to everyone as a browseProducts response for
+ * BroadcastUser.
+ *
+ * Fixed-width fields are little-endian, varints are LEB128. Payloads of
+ * browseProducts, viewCart and viewOrders are binary (see below); all other
+ * payloads, and every error, are the text the text protocol would send.
+ */
+namespace BinaryProtocol {
+
+constexpr std::string_view RequestTopic("eCommerce#");
+constexpr std::string_view ResponseTopic("eCommerce$");
+constexpr std::string_view StartOption("binary");
+constexpr std::size_t RequestHeaderSize = RequestTopic.size() + 4 + 8 + 1;
+constexpr std::size_t ResponseHeaderSize = ResponseTopic.size() + 4 + 1 + 1;
+constexpr std::uint32_t BroadcastUser = 0xFFFFFFFF;
+
+enum Opcode : std::uint8_t {
+    BrowseProducts = 1,
+    AddToCart,
+    ClearCart,
+    ViewCart,
+    Checkout,
+    Pay,
+    ViewOrders,
+    Stop,
+    UpdateCartItem,
+    CancelOrder,
+    RemoveItemFromCart,
+    AddToWishlist,
+    RemoveFromWishlist,
+    Help,
+    Stats,
+    OpcodeEnd
+};
+
+enum Status : std::uint8_t {
+    Ok = 0,
+    Error = 1
+};
+
+/**
+ * @brief The text command an opcode stands for and its number of varint arguments.
+ */
+struct Command {
+    std::string_view name;
+    std::size_t arguments;
+};
+
+inline const Command* command(std::uint8_t opcode)
+{
+    static constexpr Command commands[OpcodeEnd] = {
+        { "", 0 },
+        { "browseProducts", 1 },
+        { "addToCart", 2 },
+        { "clearCart", 0 },
+        { "viewCart", 0 },
+        { "checkout", 0 },
+        { "pay", 0 },
+        { "viewOrders", 0 },
+        { "stop", 0 },
+        { "updateCartItem", 2 },
+        { "cancelOrder", 0 },
+        { "removeItemFromCart", 2 },
+        { "addToWishlist", 1 },
+        { "removeFromWishlist", 1 },
+        { "help", 0 },
+        { "stats", 0 },
+    };
+    return opcode > 0 && opcode < OpcodeEnd ? &commands[opcode] : nullptr;
+}
+
+/**
+ * @return The opcode of a text command, 0 if it has none.
+ */
+inline std::uint8_t opcodeFor(std::string_view name)
+{
+    for (std::uint8_t opcode = 1; opcode < OpcodeEnd; ++opcode) {
+        if (command(opcode)->name == name) {
+            return opcode;
+        }
+    }
+    return 0;
+}
+
+inline void putVarint(std::string& out, std::uint64_t value)
+{
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+/**
+ * @brief Reads a varint from the front of in and advances past it.
+ *
+ * @return false if in ends inside the varint or it is longer than 64 bits.
+ */
+inline bool getVarint(std::string_view& in, std::uint64_t& value)
+{
+    value = 0;
+    for (std::size_t i = 0; i < in.size() && i < 10; ++i)
+    {
+        std::uint8_t byte = static_cast<std::uint8_t>(in[i]);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            in.remove_prefix(i + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+void putFixed(std::string& out, T value)
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        out += static_cast<char>(static_cast<std::uint64_t>(value) >> (8 * i));
+    }
+}
+
+template <typename T>
+bool getFixed(std::string_view& in, T& value)
+{
+    if (in.size() < sizeof(T)) {
+        return false;
+    }
+    std::uint64_t result = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        result |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(in[i])) << (8 * i);
+    }
+    value = static_cast<T>(result);
+    in.remove_prefix(sizeof(T));
+    return true;
+}
+
+inline void appendRequestHeader(std::string& out, std::uint32_t user, std::uint64_t secret, std::uint8_t opcode)
+{
+    out += RequestTopic;
+    putFixed(out, user);
+    putFixed(out, secret);
+    out += static_cast<char>(opcode);
+}
+
+/**
+ * @brief Parses a request header and leaves msg at the arguments.
+ */
+inline bool parseRequestHeader(std::string_view& msg, std::uint32_t& user, std::uint64_t& secret, std::uint8_t& opcode)
+{
+    if (msg.size() < RequestHeaderSize || msg.substr(0, RequestTopic.size()) != RequestTopic) {
+        return false;
+    }
+    msg.remove_prefix(RequestTopic.size());
+    return getFixed(msg, user) && getFixed(msg, secret) && getFixed(msg, opcode);
+}
+
+/**
+ * @brief The subscription prefix matching every response to one user.
+ */
+inline std::string responseTopic(std::uint32_t user)
+{
+    std::string topic(ResponseTopic);
+    putFixed(topic, user);
+    return topic;
+}
+
+inline void appendResponseHeader(std::string& out, std::uint32_t user, std::uint8_t opcode, Status status)
+{
+    out += ResponseTopic;
+    putFixed(out, user);
+    out += static_cast<char>(opcode);
+    out += static_cast<char>(status);
+}
+
+/**
+ * @brief Parses a response header and leaves msg at the payload.
+ */
+inline bool parseResponseHeader(std::string_view& msg, std::uint32_t& user, std::uint8_t& opcode, Status& status)
+{
+    if (msg.size() < ResponseHeaderSize || msg.substr(0, ResponseTopic.size()) != ResponseTopic) {
+        return false;
+    }
+    msg.remove_prefix(ResponseTopic.size());
+    std::uint8_t statusByte = 0;
+    bool parsed = getFixed(msg, user) && getFixed(msg, opcode) && getFixed(msg, statusByte);
+    status = static_cast<Status>(statusByte);
+    return parsed;
+}
+
+/*
+ * Payloads, all counts and numbers as varints and prices in cents:
+ *
+ *   browseProducts: catalog version, then, unless the request's cached
+ *                   version is current, count and per product id, price,
+ *                   name length, name
+ *   viewCart:       cart = line count, then per line product id, quantity, unit price
+ *   viewOrders:     paid flag, order count, then one cart per order
+ */
+
+/**
+ * @brief Appends a cart payload as one "Product <id> - Quantity: <n> - $<amount>" line per item.
+ */
+inline bool appendCartText(std::string& out, std::string_view& payload)
+{
+    std::uint64_t lines;
+    if (!getVarint(payload, lines)) {
+        return false;
+    }
+    std::int64_t total = 0;
+    for (std::uint64_t line = 0; line < lines; ++line)
+    {
+        std::uint64_t productId, quantity, unitPrice;
+        if (!getVarint(payload, productId) || !getVarint(payload, quantity) || !getVarint(payload, unitPrice)) {
+            return false;
+        }
+        std::int64_t lineTotal = static_cast<std::int64_t>(quantity) * static_cast<std::int64_t>(unitPrice);
+        total += lineTotal;
+        out += "Product " + std::to_string(productId) + " - Quantity: " + std::to_string(quantity) + " - $";
+        Money::appendCents(out, lineTotal);
+        out += '\n';
+    }
+    out += "Total: $";
+    Money::appendCents(out, total);
+    out += '\n';
+    return true;
+}
+
+/**
+ * @brief Renders a response payload as text for display.
+ */
+inline std::string describe(std::uint8_t opcode, Status status, std::string_view payload)
+{
+    if (status != Ok) {
+        return std::string(payload);
+    }
+    std::string text;
+    std::uint64_t count;
+    switch (opcode)
+    {
+    case BrowseProducts:
+    {
+        std::uint64_t version;
+        if (!getVarint(payload, version)) {
+            break;
+        }
+        if (payload.empty()) {
+            return "Catalog version " + std::to_string(version) + " is up to date.";
+        }
+        if (!getVarint(payload, count)) {
+            break;
+        }
+        text = "Available products (catalog version " + std::to_string(version) + "):\n";
+        for (std::uint64_t i = 0; i < count; ++i)
+        {
+            std::uint64_t id, price, length;
+            if (!getVarint(payload, id) || !getVarint(payload, price) || !getVarint(payload, length) || payload.size() < length) {
+                return "Error: Malformed response.";
+            }
+            text += std::to_string(id) + ". ";
+            text += payload.substr(0, length);
+            text += " - $";
+            Money::appendCents(text, static_cast<std::int64_t>(price));
+            text += '\n';
+            payload.remove_prefix(length);
+        }
+        return text;
+    }
+    case ViewCart:
+        text = "Cart contents:\n";
+        if (appendCartText(text, payload)) {
+            return text;
+        }
+        break;
+    case ViewOrders:
+    {
+        std::uint64_t paid;
+        if (!getVarint(payload, paid) || !getVarint(payload, count)) {
+            break;
+        }
+        text = count == 0 ? "No orders found.\n" : "Past orders:\n";
+        for (std::uint64_t order = 1; order <= count; ++order) {
+            text += "Order " + std::to_string(order) + ":\n";
+            if (!appendCartText(text, payload)) {
+                return "Error: Malformed response.";
+            }
+            text += paid ? "Payment Status: Paid\n" : "Payment Status: Pending\n";
+        }
+        return text;
+    }
+    default:
+        return std::string(payload);
+    }
+    return "Error: Malformed response.";
+}
+
+} // namespace BinaryProtocol
+
+#endif // BINARYPROTOCOL_H
@@ -0,0 +1,97 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <zmq.hpp>
+
+/**
+ * @brief Recycled string buffers that are handed to ZeroMQ without copying.
+ *
+ * A message is formatted straight into an acquired buffer and toMessage()
+ * gives the buffer itself to a zmq::message_t. ZeroMQ releases it back to
+ * the pool from its I/O thread once the message is sent, which is why the
+ * free list takes a lock. Buffers keep their capacity, so formatting a
+ * response rarely allocates. Buffers that grew
+ * beyond MaxCapacity are freed instead of kept. The pool must outlive every
+ * message made from it, i.e. the context those messages are sent through.
+ */
+class BufferPool {
+public:
+    static constexpr std::size_t MaxBuffers = 1024;
+    static constexpr std::size_t MaxCapacity = 64 * 1024;
+
+    struct Buffer {
+        BufferPool* pool;
+        std::string data;
+    };
+
+    struct Releaser {
+        void operator()(Buffer* buffer) const { buffer->pool->release(buffer); }
+    };
+
+    using Pointer = std::unique_ptr<Buffer, Releaser>;
+
+    BufferPool() = default;
+    ~BufferPool()
+    {
+        for (Buffer* buffer : buffers) {
+            delete buffer;
+        }
+    }
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * @brief Returns an empty buffer, reusing a released one when possible.
+     */
+    Pointer acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!buffers.empty()) {
+                Buffer* buffer = buffers.back();
+                buffers.pop_back();
+                return Pointer(buffer);
+            }
+        }
+        return Pointer(new Buffer{this, std::string()});
+    }
+
+    /**
+     * @brief Wraps the buffer's contents in a message without copying them.
+     */
+    static zmq::message_t toMessage(Pointer buffer)
+    {
+        Buffer* raw = buffer.release();
+        return zmq::message_t(&raw->data[0], raw->data.size(), &BufferPool::freeMessage, raw);
+    }
+
+private:
+    static void freeMessage(void*, void* hint)
+    {
+        Buffer* buffer = static_cast<Buffer*>(hint);
+        buffer->pool->release(buffer);
+    }
+
+    void release(Buffer* buffer)
+    {
+        if (buffer->data.capacity() <= MaxCapacity) {
+            buffer->data.clear();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (buffers.size() < MaxBuffers) {
+                buffers.push_back(buffer);
+                return;
+            }
+        }
+        delete buffer;
+    }
+
+    std::mutex mutex;
+    std::vector<Buffer*> buffers;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,71 @@
+#ifndef CART_H
+#define CART_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "money.h"
+
+/**
+ * @brief Line items of a cart or order as parallel arrays sorted by product.
+ *
+ * Each line keeps the unit price in cents it was added at, so totals are a
+ * single pass over contiguous quantity and price arrays and an order keeps
+ * the prices it was placed with.
+ */
+class Cart {
+public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    std::size_t size() const { return productIds.size(); }
+    bool empty() const { return productIds.empty(); }
+
+    int productId(std::size_t line) const { return productIds[line]; }
+    std::int32_t quantity(std::size_t line) const { return quantities[line]; }
+    std::int64_t unitPrice(std::size_t line) const { return unitPrices[line]; }
+    std::int64_t lineTotal(std::size_t line) const { return static_cast<std::int64_t>(quantities[line]) * unitPrices[line]; }
+
+    std::int64_t total() const
+    {
+        return Money::totalCents(quantities.data(), unitPrices.data(), quantities.size());
+    }
+
+    std::size_t find(int productId) const
+    {
+        auto it = std::lower_bound(productIds.begin(), productIds.end(), productId);
+        return it != productIds.end() && *it == productId ? static_cast<std::size_t>(it - productIds.begin()) : npos;
+    }
+
+    /**
+     * @brief Adds to the quantity of a product, creating its line if needed.
+     */
+    void add(int productId, std::int32_t quantity, std::int64_t unitPrice)
+    {
+        auto it = std::lower_bound(productIds.begin(), productIds.end(), productId);
+        std::size_t line = static_cast<std::size_t>(it - productIds.begin());
+        if (it != productIds.end() && *it == productId) {
+            quantities[line] += quantity;
+            return;
+        }
+        productIds.insert(it, productId);
+        quantities.insert(quantities.begin() + line, quantity);
+        unitPrices.insert(unitPrices.begin() + line, unitPrice);
+    }
+
+    void setQuantity(std::size_t line, std::int32_t quantity) { quantities[line] = quantity; }
+
+    void erase(std::size_t line)
+    {
+        productIds.erase(productIds.begin() + line);
+        quantities.erase(quantities.begin() + line);
+        unitPrices.erase(unitPrices.begin() + line);
+    }
+
+private:
+    std::vector<int> productIds;
+    std::vector<std::int32_t> quantities;
+    std::vector<std::int64_t> unitPrices;
+};
+
+#endif // CART_H
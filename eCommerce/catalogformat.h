@@ -0,0 +1,80 @@
+#ifndef CATALOGFORMAT_H
+#define CATALOGFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief On-disk layout of a binary product catalog.
+ *
+ * The file is used in place after being memory-mapped, so every section is
+ * the exact in-memory array ProductCatalog reads from, 8-byte aligned and in
+ * the host's (little-endian) byte order:
+ *
+ *   CatalogFileHeader
+ *   std::int64_t  prices[slotCount]     (cents)
+ *   std::uint8_t  present[slotCount]
+ *   std::uint32_t nameOffsets[slotCount + 1]
+ *   char          names[nameBytes]
+ *
+ * Slot i holds product ID i; slot 0 is never present. The version must be
+ * bumped whenever this layout changes.
+ */
+namespace CatalogFormat {
+
+constexpr char Magic[4] = { 'E', 'C', 'A', 'T' };
+constexpr std::uint32_t Version = 2;
+
+struct CatalogFileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t slotCount;
+    std::uint64_t productCount;
+    std::uint64_t nameBytes;
+};
+
+struct Layout {
+    std::size_t prices;
+    std::size_t present;
+    std::size_t nameOffsets;
+    std::size_t names;
+    std::size_t fileSize;
+};
+
+constexpr std::size_t align8(std::size_t offset)
+{
+    return (offset + 7) & ~static_cast<std::size_t>(7);
+}
+
+constexpr Layout layout(std::uint64_t slotCount, std::uint64_t nameBytes)
+{
+    Layout result{};
+    result.prices = align8(sizeof(CatalogFileHeader));
+    result.present = align8(result.prices + slotCount * sizeof(std::int64_t));
+    result.nameOffsets = align8(result.present + slotCount * sizeof(std::uint8_t));
+    result.names = align8(result.nameOffsets + (slotCount + 1) * sizeof(std::uint32_t));
+    result.fileSize = result.names + nameBytes;
+    return result;
+}
+
+/**
+ * @brief Whether the sections of a header fit in a file of fileSize bytes.
+ *
+ * Both counts are bounded before the sum is taken, so a corrupt header
+ * cannot wrap it; layout() is only safe to use once this holds.
+ */
+constexpr bool fits(std::uint64_t slotCount, std::uint64_t nameBytes, std::uint64_t fileSize)
+{
+    if (slotCount > UINT32_MAX || nameBytes > UINT32_MAX) {
+        return false;
+    }
+    auto align = [](std::uint64_t offset) { return (offset + 7) & ~static_cast<std::uint64_t>(7); };
+    std::uint64_t present = align(align(sizeof(CatalogFileHeader)) + slotCount * sizeof(std::int64_t));
+    std::uint64_t nameOffsets = align(present + slotCount * sizeof(std::uint8_t));
+    std::uint64_t names = align(nameOffsets + (slotCount + 1) * sizeof(std::uint32_t));
+    return names <= fileSize && nameBytes <= fileSize - names;
+}
+
+} // namespace CatalogFormat
+
+#endif // CATALOGFORMAT_H
@@ -7,13 +7,21 @@ CONFIG += c++17 cmdline
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 DEFINES += ZMQ_STATIC
-LIBS += -L$$PWD/../lib -lzmq -lws2_32 -lIphlpapi
-INCLUDEPATH += $$PWD/../include
+LIBS += -L$$PWD/../lib -lzmq
+win32: LIBS += -lws2_32 -lIphlpapi
+INCLUDEPATH += $$PWD/../include $$PWD/../Broker
 
 SOURCES += \
+        ../Broker/broker.cpp \
         ecommerce.cpp \
         loggingcategories.cpp \
-        main.cpp
+        main.cpp \
+        productcatalog.cpp \
+        productindex.cpp \
+        snapshotstore.cpp \
+        suggesttrie.cpp \
+        timerwheel.cpp \
+        writeaheadlog.cpp
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -21,5 +29,23 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    ../Broker/broker.h \
+    binaryprotocol.h \
+    bufferpool.h \
+    cart.h \
+    catalogformat.h \
+    checksum.h \
     ecommerce.h \
-    loggingcategories.h
+    latencyhistogram.h \
+    loggingcategories.h \
+    messagetokenizer.h \
+    mpscqueue.h \
+    money.h \
+    productcatalog.h \
+    productindex.h \
+    sessiontoken.h \
+    snapshotstore.h \
+    suggesttrie.h \
+    timerwheel.h \
+    usertable.h \
+    writeaheadlog.h
@@ -1,6 +1,9 @@
 #include "ecommerce.h"
+#include "checksum.h"
+#include "sessiontoken.h"
+#include <QSaveFile>
+#include <cstdio>
 #include <iostream>
-#include <sstream>
 #include <chrono>
 #include <thread>
 #include <cstdlib>
@@ -9,26 +12,110 @@
 #include <unordered_map>
 #include <mutex>
 #include <functional>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <charconv>
 #include <iostream>
 
-eCommerce::eCommerce(QCoreApplication *a)
-    : context(1), subscriber(context, ZMQ_SUB), pusher(context, ZMQ_PUSH), running(true)
+namespace {
+
+constexpr std::chrono::seconds HeartbeatInterval(60);
+constexpr int DefaultSearchResults = 20;
+// Log record of a forgotten account; not a command, so clients cannot send it
+constexpr std::string_view ForgetUserRecord("forgetUser");
+constexpr int MaxSearchResults = 100;
+
+/**
+ * @brief Converts the time until a wheel's next timer into a zmq::poll timeout.
+ */
+std::chrono::milliseconds pollTimeout(const TimerWheel& timers)
+{
+    TimerWheel::Clock::duration wait = timers.timeUntilNext(TimerWheel::Clock::now());
+    if (wait < TimerWheel::Clock::duration::zero()) {
+        return std::chrono::milliseconds(-1);
+    }
+    return std::chrono::ceil<std::chrono::milliseconds>(wait);
+}
+
+// Control message asking a worker for its shard image; client messages
+// always start with the topic, so they can never look like this
+constexpr std::string_view SnapshotRequest("\0snapshot", 9);
+
+void writeCart(SnapshotWriter& writer, const Cart& cart)
+{
+    writer.put<std::uint32_t>(static_cast<std::uint32_t>(cart.size()));
+    for (std::size_t line = 0; line < cart.size(); ++line) {
+        writer.put<std::int32_t>(cart.productId(line));
+        writer.put<std::int32_t>(cart.quantity(line));
+        writer.put<std::int64_t>(cart.unitPrice(line));
+    }
+}
+
+/**
+ * @brief Appends a cart in the binary protocol's cart payload format.
+ */
+void putCart(std::string& out, const Cart& cart)
+{
+    BinaryProtocol::putVarint(out, cart.size());
+    for (std::size_t line = 0; line < cart.size(); ++line) {
+        BinaryProtocol::putVarint(out, static_cast<std::uint64_t>(cart.productId(line)));
+        BinaryProtocol::putVarint(out, static_cast<std::uint64_t>(cart.quantity(line)));
+        BinaryProtocol::putVarint(out, static_cast<std::uint64_t>(cart.unitPrice(line)));
+    }
+}
+
+Cart readCart(SnapshotReader& reader)
+{
+    Cart cart;
+    std::uint32_t lines = reader.get<std::uint32_t>();
+    for (std::uint32_t line = 0; line < lines; ++line) {
+        int productId = reader.get<std::int32_t>();
+        std::int32_t quantity = reader.get<std::int32_t>();
+        cart.add(productId, quantity, reader.get<std::int64_t>());
+    }
+    return cart;
+}
+
+} // namespace
+
+eCommerce::eCommerce(QCoreApplication *a, const ServerConfig& config)
+    : context(1), subscriber(context, ZMQ_SUB), pusher(context, ZMQ_PUSH),
+      wakeupReceiver(context, ZMQ_PAIR), wakeupSender(context, ZMQ_PAIR),
+      config(config), workerCount(config.workerCount > 0 ? config.workerCount : defaultWorkerCount()), running(true)
 {
     srand(time(0));
-    qCInfo(ecommercelog) << "eCommerce server starting...";
+    qCInfo(ecommercelog) << "eCommerce server starting with" << this->workerCount << "worker threads...";
     initializeProducts();
     setupConnections();
+    recoverState();
     startThreads();
 }
 
 eCommerce::~eCommerce()
 {
     running = false;
+    try
+    {
+        // Wake the server loop out of its blocking poll
+        wakeupSender.send(zmq::str_buffer("stop"), zmq::send_flags::dontwait);
+    }
+    catch (zmq::error_t& ex)
+    {
+        qCCritical(ecommercelog) << "Caught an exception:" << ex.what();
+    }
     if (serverThread.joinable()) {
         serverThread.join();
     }
-    if (heartbeatThread.joinable()) {
-        heartbeatThread.join();
+    for (auto& workerThread : workerThreads) {
+        if (workerThread.joinable()) {
+            workerThread.join();
+        }
+    }
+    // Only now that nothing produces responses any more
+    outbox.close();
+    if (senderThread.joinable()) {
+        senderThread.join();
     }
 }
 
@@ -36,15 +123,36 @@ void eCommerce::setupConnections()
 {
     try
     {
-        subscriber.connect("tcp://benternet.pxl-ea-ict.be:24042");
-        qCInfo(ecommercelog) << "Subscriber connected to endpoint.";
-        pusher.connect("tcp://benternet.pxl-ea-ict.be:24041");
-        qCInfo(ecommercelog) << "Pusher connected to endpoint.";
+        if (config.embeddedBroker) {
+            broker = std::make_unique<Broker>(context, config.pushEndpoint, config.subscribeEndpoint);
+            broker->start();
+            qCInfo(ecommercelog) << "Embedded broker forwarding" << config.pushEndpoint.c_str()
+                                 << "to" << config.subscribeEndpoint.c_str();
+        }
+        subscriber.connect(config.subscribeEndpoint);
+        qCInfo(ecommercelog) << "Subscriber connected to" << config.subscribeEndpoint.c_str();
+        pusher.connect(config.pushEndpoint);
+        qCInfo(ecommercelog) << "Pusher connected to" << config.pushEndpoint.c_str();
 
         const char* topic = "eCommerce?";
         subscriber.set(zmq::sockopt::subscribe, topic);
-        subscriber.set(zmq::sockopt::rcvtimeo, 1000);
         qCInfo(ecommercelog) << "Subscribed to topic:" << topic;
+        subscriber.set(zmq::sockopt::subscribe, BinaryProtocol::RequestTopic.data());
+        qCInfo(ecommercelog) << "Subscribed to topic:" << BinaryProtocol::RequestTopic.data();
+
+        wakeupReceiver.bind("inproc://ecommerce-wakeup");
+        wakeupSender.connect("inproc://ecommerce-wakeup");
+
+        for (std::size_t i = 0; i < workerCount; ++i)
+        {
+            std::string endpoint = "inproc://ecommerce-worker-" + std::to_string(i);
+            shards.push_back(std::make_unique<Shard>());
+            shards.back()->index = i;
+            workerReceivers.emplace_back(context, ZMQ_PULL);
+            workerReceivers.back().bind(endpoint);
+            workerSenders.emplace_back(context, ZMQ_PUSH);
+            workerSenders.back().connect(endpoint);
+        }
     }
     catch (zmq::error_t& ex)
     {
@@ -52,28 +160,177 @@ void eCommerce::setupConnections()
     }
 }
 
+/**
+ * @brief Rebuilds the user state from the latest snapshot and the log tail.
+ *
+ * Records a shard's snapshot image already covers are skipped, so start-up
+ * time depends on the snapshot size and the log written since, not on the
+ * whole history. Runs before the worker threads start, so the shards can be
+ * filled from this thread.
+ *
+ * @throws std::exception if the snapshot or the log cannot be read.
+ */
+void eCommerce::recoverState()
+{
+    if (config.walPath.empty()) {
+        return;
+    }
+
+    try
+    {
+        std::vector<SnapshotStore::ShardImage> images = SnapshotStore::load(config.snapshotPath);
+        std::uint64_t snapshotLsn = 0;
+        std::uint64_t oldestImageLsn = images.empty() ? 0 : images.front().lsn;
+        std::unordered_map<std::string_view, std::uint64_t> userLsns;     // views into images
+        for (const SnapshotStore::ShardImage& image : images) {
+            restoreShardImage(image.data, image.lsn, userLsns);
+            snapshotLsn = std::max(snapshotLsn, image.lsn);
+            oldestImageLsn = std::min(oldestImageLsn, image.lsn);
+        }
+        if (!images.empty()) {
+            qCInfo(ecommercelog) << "Loaded snapshot of" << images.size() << "shards up to LSN" << snapshotLsn;
+        }
+
+        std::uint64_t replayed = 0;
+        std::uint64_t lastLsn = wal.open(config.walPath, config.walSyncPolicy, config.walSyncInterval,
+                                         [&](std::uint64_t lsn, const MessageSegments& fields) {
+            if (fields.size() < 4) {
+                return;
+            }
+            // Skip what the user's image already holds. A user in no image
+            // was created after its shard's image, so after the oldest one,
+            // or forgotten before it, which its replayed records end with.
+            auto userLsn = userLsns.find(fields[1]);
+            if (lsn <= (userLsn != userLsns.end() ? userLsn->second : oldestImageLsn)) {
+                return;
+            }
+            Shard& shard = *shards[workerForUser(fields[1])];
+            if (fields[2] == ForgetUserRecord) {
+                shard.removeUser(shard.users.find(fields[1]));
+                ++replayed;
+                return;
+            }
+            shard.replaying = true;
+            dispatchCommand(shard, fields);
+            shard.replaying = false;
+            ++replayed;
+        }, snapshotLsn);
+        qCInfo(ecommercelog) << "Replayed" << replayed << "write-ahead log records up to LSN" << lastLsn;
+
+        // Every shard now reflects the whole log
+        for (auto& shard : shards) {
+            shard->appliedLsn = lastLsn;
+        }
+        snapshots.open(config.snapshotPath, [this](std::uint64_t coveredLsn) { wal.truncate(coveredLsn); });
+        serverTimers.schedule(config.snapshotInterval, SnapshotTimer);
+    }
+    catch (const std::exception& e)
+    {
+        // Serving from partial state would let accounts be claimed again and
+        // diverge from the log the next good start replays
+        qCCritical(ecommercelog) << "Caught an exception:" << e.what();
+        qCCritical(ecommercelog) << "Cannot recover the state from the write-ahead log and snapshot; not starting.";
+        throw;
+    }
+}
+
+/**
+ * @brief Encodes the user state of a shard for a snapshot.
+ *
+ * Called by the owning worker, so the state is consistent without locking.
+ */
+std::string eCommerce::encodeShard(const Shard& shard)
+{
+    std::string data;
+    SnapshotWriter writer(data);
+
+    writer.put<std::uint32_t>(static_cast<std::uint32_t>(shard.users.liveCount()));
+    for (UserId user = 0; user < shard.users.size(); ++user)
+    {
+        if (!shard.users.contains(user)) {
+            continue;
+        }
+        writer.putString(shard.users.name(user));
+        writer.putString(shard.passwords[user]);
+        writeCart(writer, shard.carts[user]);
+        writer.put<std::uint32_t>(static_cast<std::uint32_t>(shard.orders[user].size()));
+        for (const Cart& order : shard.orders[user]) {
+            writeCart(writer, order);
+        }
+        writer.put<std::uint8_t>(shard.paid[user]);
+        writer.put<std::uint32_t>(static_cast<std::uint32_t>(shard.wishlists[user].size()));
+        for (int productId : shard.wishlists[user]) {
+            writer.put<std::int32_t>(productId);
+        }
+    }
+    return data;
+}
+
+/**
+ * @brief Adds the users of a snapshot image to the shards that now own them.
+ *
+ * Also notes the image's LSN for every user, so replay can skip the
+ * records the image covers without relying on how users were sharded
+ * when it was taken.
+ *
+ * @throws std::runtime_error if the image is truncated.
+ */
+void eCommerce::restoreShardImage(std::string_view data, std::uint64_t lsn,
+                                  std::unordered_map<std::string_view, std::uint64_t>& userLsns)
+{
+    SnapshotReader reader(data);
+
+    for (std::uint32_t count = reader.get<std::uint32_t>(); count > 0; --count)
+    {
+        std::string_view username = reader.getString();
+        userLsns[username] = lsn;
+        Shard& shard = *shards[workerForUser(username)];
+        UserId user = shard.addUser(username);
+        shard.passwords[user] = std::string(reader.getString());
+        shard.carts[user] = readCart(reader);
+        for (std::uint32_t orders = reader.get<std::uint32_t>(); orders > 0; --orders) {
+            shard.orders[user].push_back(readCart(reader));
+        }
+        shard.paid[user] = reader.get<std::uint8_t>();
+        for (std::uint32_t items = reader.get<std::uint32_t>(); items > 0; --items) {
+            shard.wishlists[user].insert(reader.get<std::int32_t>());
+        }
+    }
+}
+
 void eCommerce::startThreads()
 {
+    for (std::size_t i = 0; i < workerCount; ++i) {
+        workerThreads.emplace_back(&eCommerce::workerTask, this, i);
+    }
+    startTime = TimerWheel::Clock::now();
+    serverTimers.schedule(TimerWheel::Clock::duration::zero(), HeartbeatTimer);
+    serverTimers.schedule(config.catalogInterval, CatalogTimer);
+    senderThread = std::thread(&eCommerce::senderTask, this);
     serverThread = std::thread(&eCommerce::serverTask, this);
-    heartbeatThread = std::thread(&eCommerce::heartbeatTask, this);
 }
 
 void eCommerce::serverTask()
 {
+    zmq::pollitem_t items[] = {
+        { static_cast<void*>(subscriber), 0, ZMQ_POLLIN, 0 },
+        { static_cast<void*>(wakeupReceiver), 0, ZMQ_POLLIN, 0 }
+    };
+
     while (running)
     {
         try
         {
-            zmq::message_t msg;
-            if (subscriber.recv(msg, zmq::recv_flags::dontwait))
-            {
-                std::string receivedMsg(static_cast<char*>(msg.data()), msg.size());
-                qCInfo(ecommercelog) << "Subscriber received:" << receivedMsg.c_str();
+            // Sleep until a message arrives, a timer is due or the destructor wakes us up
+            zmq::poll(items, 2, pollTimeout(serverTimers));
 
-                if (receivedMsg.find("eCommerce!>") == std::string::npos) {
-                    handleMessage(receivedMsg);
-                }
+            if (items[1].revents & ZMQ_POLLIN) {
+                break;
             }
+            if (items[0].revents & ZMQ_POLLIN) {
+                drainSubscriber();
+            }
+            runServerTimers();
         }
         catch (zmq::error_t& ex)
         {
@@ -85,198 +342,1020 @@ void eCommerce::serverTask()
             qCCritical(ecommercelog) << "Caught an exception:" << e.what();
         }
     }
+
+    stopWorkers();
+}
+
+/**
+ * @brief Sends the queued outgoing messages; the only user of the pusher socket.
+ *
+ * Every wakeup sends everything queued by then, so under load one wakeup
+ * covers many responses. Messages still queued at shutdown are sent first.
+ */
+void eCommerce::senderTask()
+{
+    zmq::message_t message;
+    while (true)
+    {
+        try
+        {
+            while (outbox.tryPop(message)) {
+                pusher.send(message, zmq::send_flags::none);
+            }
+            if (outbox.isClosed()) {
+                break;
+            }
+            outbox.wait();
+        }
+        catch (zmq::error_t& ex)
+        {
+            qCCritical(ecommercelog) << "Caught an exception:" << ex.what();
+            pusher.connect(config.pushEndpoint);
+            qCInfo(ecommercelog) << "Pusher reconnected to endpoint.";
+        }
+    }
+}
+
+/**
+ * @brief Queues a copy of a message for the sender thread; callable from any thread.
+ */
+void eCommerce::send(std::string_view message)
+{
+    BufferPool::Pointer buffer = messageBuffers.acquire();
+    buffer->data.assign(message);
+    outbox.push(BufferPool::toMessage(std::move(buffer)));
+}
+
+/**
+ * @brief Dispatches every message currently queued on the subscriber socket.
+ *
+ * Called after the poller reports the subscriber readable, so a burst of
+ * requests is processed in a single wakeup.
+ */
+void eCommerce::drainSubscriber()
+{
+    zmq::message_t msg;
+    while (running && subscriber.recv(msg, zmq::recv_flags::dontwait))
+    {
+        dispatchMessage(msg);
+    }
+}
+
+/**
+ * @brief Hands a received message to the worker that owns its user.
+ *
+ * The message buffer is moved into the worker queue, so nothing is copied
+ * on the receive thread.
+ */
+void eCommerce::dispatchMessage(zmq::message_t& msg)
+{
+    std::string_view receivedMsg(msg.data<char>(), msg.size());
+    bool binary = receivedMsg.substr(0, BinaryProtocol::RequestTopic.size()) == BinaryProtocol::RequestTopic;
+    bool accepted = binary || (!receivedMsg.empty() && receivedMsg.find("eCommerce!>") == std::string_view::npos);
+
+    std::size_t index = 0;
+    if (accepted) {
+        index = workerFor(receivedMsg);
+        ShardStats& stats = shards[index]->stats;
+        std::uint64_t depth = stats.dispatched.fetch_add(1, std::memory_order_relaxed) + 1
+                              - stats.handled.load(std::memory_order_relaxed);
+        if (depth > stats.maxQueueDepth.load(std::memory_order_relaxed)) {
+            stats.maxQueueDepth.store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    // The frames of a batch follow its first frame to the same worker; a
+    // multipart message is delivered whole, so receiving them never blocks
+    while (true)
+    {
+        bool more = msg.more();
+        if (accepted) {
+            workerSenders[index].send(msg, more ? zmq::send_flags::sndmore : zmq::send_flags::none);
+        }
+        if (!more) {
+            break;
+        }
+        if (!subscriber.recv(msg, zmq::recv_flags::none)) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Picks the worker for a message by hashing its username segment.
+ *
+ * All commands of one user land on the same worker and are therefore
+ * handled in the order they were received. Binary requests carry the
+ * global user ID, which names the shard directly.
+ */
+std::size_t eCommerce::workerFor(std::string_view msg) const
+{
+    std::uint32_t user;
+    std::uint64_t secret;
+    std::uint8_t opcode;
+    if (BinaryProtocol::parseRequestHeader(msg, user, secret, opcode)) {
+        return user % workerCount;
+    }
+
+    std::size_t userStart = msg.find('>');
+    if (userStart == std::string_view::npos) {
+        return 0;
+    }
+    ++userStart;
+    std::size_t userEnd = msg.find('>', userStart);
+    return workerForUser(msg.substr(userStart, userEnd == std::string_view::npos ? std::string_view::npos : userEnd - userStart));
+}
+
+std::size_t eCommerce::workerForUser(std::string_view username) const
+{
+    return std::hash<std::string_view>{}(username) % workerCount;
+}
+
+/**
+ * @brief Asks every worker to hand in an image of its shard.
+ *
+ * The request is queued behind the commands already dispatched, so each
+ * worker encodes its shard between two commands and the receive loop never
+ * stops. The images are written to disk by the snapshot store's own thread.
+ */
+void eCommerce::requestSnapshot()
+{
+    serverTimers.schedule(config.snapshotInterval, SnapshotTimer);
+    if (!snapshots.begin(workerCount)) {
+        qCWarning(ecommercelog) << "Previous snapshot still in progress, skipping this one.";
+        return;
+    }
+    for (auto& workerSender : workerSenders) {
+        workerSender.send(zmq::buffer(SnapshotRequest), zmq::send_flags::none);
+    }
+}
+
+void eCommerce::stopWorkers()
+{
+    // An empty message tells a worker to leave its loop
+    for (auto& workerSender : workerSenders)
+    {
+        try
+        {
+            workerSender.send(zmq::message_t(), zmq::send_flags::none);
+        }
+        catch (zmq::error_t& ex)
+        {
+            qCCritical(ecommercelog) << "Caught an exception:" << ex.what();
+        }
+    }
+}
+
+void eCommerce::workerTask(std::size_t index)
+{
+    zmq::socket_t& queue = workerReceivers[index];
+    zmq::pollitem_t items[] = { { static_cast<void*>(queue), 0, ZMQ_POLLIN, 0 } };
+    Shard& shard = *shards[index];
+
+    // Recovered users get their full timeouts from now
+    shard.now = TimerWheel::Clock::now();
+    for (UserId user = 0; user < shard.users.size(); ++user) {
+        if (shard.users.contains(user)) {
+            touchUser(shard, user);
+        }
+    }
+
+    while (true)
+    {
+        try
+        {
+            // Only sleep when the queue is empty, and no longer than the next idle timer
+            zmq::message_t msg;
+            bool received = queue.recv(msg, zmq::recv_flags::dontwait).has_value();
+            shard.batchFrames.clear();
+            for (bool more = received && msg.more(); more; more = shard.batchFrames.back().more()) {
+                shard.batchFrames.emplace_back();
+                if (!queue.recv(shard.batchFrames.back(), zmq::recv_flags::none)) {
+                    qCWarning(ecommercelog) << "Dropping a batch whose frames did not all arrive.";
+                    shard.batchFrames.clear();
+                    received = false;
+                    break;
+                }
+            }
+            if (!received) {
+                zmq::poll(items, 1, pollTimeout(shard.timers));
+            }
+            shard.now = TimerWheel::Clock::now();
+            runUserTimers(shard);
+            if (!received) {
+                continue;
+            }
+            if (msg.size() == 0) {
+                break;
+            }
+            if (std::string_view(msg.data<char>(), msg.size()) == SnapshotRequest) {
+                // Not appliedLsn, which an idle shard never advances
+                snapshots.submit(index, wal.lastLsn(), encodeShard(shard));
+                continue;
+            }
+
+            auto begin = shard.now;
+            std::string_view receivedMsg(msg.data<char>(), msg.size());
+            const CommandEntry* entry = handleMessage(shard, receivedMsg);
+
+            std::uint64_t heldNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+            if (entry) {
+                shard.stats.latencies[entry - commandTable().data()].record(heldNanos);
+            }
+            shard.stats.holdNanos.fetch_add(heldNanos, std::memory_order_relaxed);
+            shard.stats.handled.fetch_add(1, std::memory_order_relaxed);
+        }
+        catch (zmq::error_t& ex)
+        {
+            qCCritical(ecommercelog) << "Caught an exception:" << ex.what();
+            if (ex.num() == ETERM) {
+                break;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            qCCritical(ecommercelog) << "Caught an exception:" << e.what();
+        }
+    }
+}
+
+void eCommerce::logShardStats()
+{
+    for (std::size_t i = 0; i < shards.size(); ++i)
+    {
+        const ShardStats& stats = shards[i]->stats;
+        std::uint64_t dispatched = stats.dispatched.load(std::memory_order_relaxed);
+        std::uint64_t handled = stats.handled.load(std::memory_order_relaxed);
+        qCInfo(ecommercelog) << "Shard" << i
+                             << "dispatched:" << dispatched
+                             << "handled:" << handled
+                             << "queue depth:" << (dispatched - handled)
+                             << "max queue depth:" << stats.maxQueueDepth.load(std::memory_order_relaxed)
+                             << "hold ms:" << stats.holdNanos.load(std::memory_order_relaxed) / 1000000;
+    }
+}
+
+std::size_t eCommerce::defaultWorkerCount()
+{
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 4;
 }
 
 void eCommerce::reconnect()
 {
-    subscriber.connect("tcp://benternet.pxl-ea-ict.be:24042");
+    subscriber.connect(config.subscribeEndpoint);
     qCInfo(ecommercelog) << "Subscriber reconnected to endpoint.";
-    pusher.connect("tcp://benternet.pxl-ea-ict.be:24041");
-    qCInfo(ecommercelog) << "Pusher reconnected to endpoint.";
 }
 
-void eCommerce::heartbeatTask()
+/**
+ * @brief Fires the due timers of the server thread: heartbeats and snapshots.
+ */
+void eCommerce::runServerTimers()
 {
-    while (running)
+    std::vector<std::uint64_t> fired;
+    serverTimers.advance(TimerWheel::Clock::now(), fired);
+    for (std::uint64_t timer : fired)
     {
-        sendHeartbeat();
-        std::this_thread::sleep_for(std::chrono::seconds(60));
+        switch (timer)
+        {
+        case HeartbeatTimer:
+            sendHeartbeat();
+            logShardStats();
+            writeStatsFile();
+            serverTimers.schedule(HeartbeatInterval, HeartbeatTimer);
+            break;
+        case SnapshotTimer:
+            requestSnapshot();
+            break;
+        case CatalogTimer:
+            broadcastCatalog();
+            serverTimers.schedule(config.catalogInterval, CatalogTimer);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Fires the due idle timers of a shard; called by its worker.
+ */
+void eCommerce::runUserTimers(Shard& shard)
+{
+    thread_local std::vector<std::uint64_t> fired;
+    fired.clear();
+    shard.timers.advance(shard.now, fired);
+    for (std::uint64_t user : fired) {
+        shard.idleTimers[user] = TimerWheel::NoTimer;
+        expireUser(shard, static_cast<UserId>(user));
     }
 }
 
+/**
+ * @brief Records activity of a user and makes sure an idle timer is armed.
+ *
+ * The timer is not moved on every command: when it fires, expireUser()
+ * checks the last activity and re-arms it for the remaining time.
+ */
+void eCommerce::touchUser(Shard& shard, UserId user)
+{
+    shard.lastActive[user] = shard.now;
+    if (shard.idleTimers[user] == TimerWheel::NoTimer) {
+        shard.idleTimers[user] = shard.timers.schedule(std::min<TimerWheel::Clock::duration>(config.sessionTimeout, config.cartTimeout), user);
+    }
+}
+
+/**
+ * @brief Ends the idle session of a user, evicts an abandoned cart and
+ *        forgets an abandoned account.
+ *
+ * An account is only forgotten when it holds nothing but its password: no
+ * session, cart, orders or wishlist. Its ID is then reused, so a shard's
+ * memory follows the users active within the account timeout plus those
+ * with orders or a wishlist. Re-arms the idle timer while any of these
+ * steps is still ahead.
+ */
+void eCommerce::expireUser(Shard& shard, UserId user)
+{
+    TimerWheel::Clock::duration idle = shard.now - shard.lastActive[user];
+    if (shard.sessions[user] != 0 && idle >= config.sessionTimeout) {
+        shard.sessions[user] = 0;
+    }
+    if (!shard.carts[user].empty() && idle >= config.cartTimeout) {
+        evictCart(shard, user);
+    }
+    bool abandoned = shard.sessions[user] == 0 && shard.carts[user].empty()
+                     && shard.orders[user].empty() && shard.wishlists[user].empty();
+    if (abandoned && idle >= config.accountTimeout) {
+        forgetUser(shard, user);
+        return;
+    }
+
+    TimerWheel::Clock::duration remaining = TimerWheel::Clock::duration::max();
+    if (shard.sessions[user] != 0) {
+        remaining = std::min<TimerWheel::Clock::duration>(remaining, config.sessionTimeout - idle);
+    }
+    if (!shard.carts[user].empty()) {
+        remaining = std::min<TimerWheel::Clock::duration>(remaining, config.cartTimeout - idle);
+    }
+    if (shard.carts[user].empty() && shard.orders[user].empty() && shard.wishlists[user].empty()) {
+        remaining = std::min<TimerWheel::Clock::duration>(remaining, config.accountTimeout - idle);
+    }
+    if (remaining != TimerWheel::Clock::duration::max()) {
+        shard.idleTimers[user] = shard.timers.schedule(remaining, user);
+    }
+}
+
+/**
+ * @brief Drops an abandoned cart, logged as a clearCart so replay agrees.
+ */
+void eCommerce::evictCart(Shard& shard, UserId user)
+{
+    qCInfo(ecommercelog) << "Evicting abandoned cart of user: " << shard.users.name(user);
+    if (wal.isOpen()) {
+        MessageSegments segments;
+        segments.push_back("eCommerce?");
+        segments.push_back(shard.users.name(user));
+        segments.push_back("clearCart");
+        segments.push_back(shard.passwords[user]);
+        shard.appliedLsn = wal.append(segments, 1);
+    }
+    shard.carts[user] = Cart();
+}
+
+/**
+ * @brief Forgets an abandoned account, logged so replay forgets it too.
+ */
+void eCommerce::forgetUser(Shard& shard, UserId user)
+{
+    qCInfo(ecommercelog) << "Forgetting abandoned account of user: " << shard.users.name(user);
+    if (wal.isOpen()) {
+        MessageSegments segments;
+        segments.push_back("eCommerce?");
+        segments.push_back(shard.users.name(user));
+        segments.push_back(ForgetUserRecord);
+        segments.push_back(shard.passwords[user]);
+        shard.appliedLsn = wal.append(segments, 1);
+    }
+    shard.removeUser(user);
+}
+
 void eCommerce::initializeProducts()
 {
-    products = {
-        {1, {"Apple iPhone 13", 799.00}},
-        {2, {"Samsung Galaxy S21", 699.00}},
-        {3, {"Sony WH-1000XM4 Headphones", 349.00}},
-        {4, {"Apple MacBook Pro 14\"", 1999.00}},
-        {5, {"Dell XPS 13 Laptop", 999.00}},
-        {6, {"Nintendo Switch", 299.00}},
-        {7, {"Amazon Echo Dot (4th Gen)", 49.99}},
-        {8, {"Fitbit Charge 5", 179.95}},
-        {9, {"Instant Pot Duo 7-in-1", 89.00}},
-        {10, {"Sony PlayStation 5", 499.00}}
+    if (config.catalogPath.empty()) {
+        loadDefaultProducts();
+    } else {
+        try
+        {
+            products.load(config.catalogPath);
+            qCInfo(ecommercelog) << "Mapped catalog file" << config.catalogPath.c_str();
+        }
+        catch (const std::exception& e)
+        {
+            qCCritical(ecommercelog) << "Caught an exception:" << e.what();
+            qCWarning(ecommercelog) << "Falling back to the built-in products.";
+            loadDefaultProducts();
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    productIndex.build(products);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    qCInfo(ecommercelog) << "Indexed" << productIndex.wordCount() << "words with"
+                         << productIndex.postingCount() << "postings in" << elapsed.count() << "ms.";
+
+    start = std::chrono::steady_clock::now();
+    suggestions.build(products);
+    elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    qCInfo(ecommercelog) << "Built the suggestion trie with" << suggestions.nodeCount() << "nodes in" << elapsed.count() << "ms.";
+    publishCatalog();
+}
+
+void eCommerce::loadDefaultProducts()
+{
+    static const std::pair<const char*, std::int64_t> defaultProducts[] = {
+        {"Apple iPhone 13", 79900},
+        {"Samsung Galaxy S21", 69900},
+        {"Sony WH-1000XM4 Headphones", 34900},
+        {"Apple MacBook Pro 14\"", 199900},
+        {"Dell XPS 13 Laptop", 99900},
+        {"Nintendo Switch", 29900},
+        {"Amazon Echo Dot (4th Gen)", 4999},
+        {"Fitbit Charge 5", 17995},
+        {"Instant Pot Duo 7-in-1", 8900},
+        {"Sony PlayStation 5", 49900}
     };
+
+    products.clear();
+    int id = 1;
+    for (const auto& product : defaultProducts) {
+        products.add(id++, product.first, product.second);
+    }
+}
+
+/**
+ * @brief Re-encodes the browseProducts response after a catalog change.
+ *
+ * Must be called whenever the product catalog changes. Workers keep sending the
+ * previous response until the new one is swapped in.
+ */
+void eCommerce::publishCatalog()
+{
+    auto response = std::make_shared<CatalogResponse>();
+    std::string payload = getBrowseProductsPayload();
+    response->version = (fnv1a(payload.data(), payload.size()) & 0x7FFFFFFF) | 1;
+    response->message = "Available products (catalog version " + std::to_string(response->version) + "):\n";
+    response->message += getBrowseProductsMessage();
+    BinaryProtocol::putVarint(response->binaryMessage, response->version);
+    response->binaryMessage += payload;
+    qCInfo(ecommercelog) << "Published catalog version" << response->version << "with" << products.size() << "products.";
+    std::atomic_store(&catalogResponse, std::shared_ptr<const CatalogResponse>(std::move(response)));
+    broadcastCatalog();
+}
+
+/**
+ * @brief Publishes the current catalog to every client on the catalog topics.
+ *
+ * Text clients get it on "eCommerce!catalog>version>", binary clients as a
+ * browseProducts response for BinaryProtocol::BroadcastUser. Clients cache
+ * it and only ask browseProducts whether their version is still current.
+ */
+void eCommerce::broadcastCatalog()
+{
+    std::shared_ptr<const CatalogResponse> response = std::atomic_load(&catalogResponse);
+    std::string message = "eCommerce!catalog>" + std::to_string(response->version) + ">";
+    message += response->message;
+    send(message);
+
+    message.clear();
+    BinaryProtocol::appendResponseHeader(message, BinaryProtocol::BroadcastUser, BinaryProtocol::BrowseProducts, BinaryProtocol::Ok);
+    message += response->binaryMessage;
+    send(message);
 }
 
 void eCommerce::sendHeartbeat()
 {
-    std::string heartbeat = "eCommerce?>keepalive>heartbeat>";
-    pusher.send(zmq::buffer(heartbeat), zmq::send_flags::none);
+    send("eCommerce?>keepalive>heartbeat>");
     qCInfo(heartbeatlog) << "Sent heartbeat message.";
 }
 
 void eCommerce::receiveHeartbeat()
 {
-    std::string heartbeat = "eCommerce!>heartbeat>pulse";
-    pusher.send(zmq::buffer(heartbeat), zmq::send_flags::none);
+    send("eCommerce!>heartbeat>pulse");
     qCInfo(heartbeatlog) << "Received heartbeat message.";
 }
 
-void eCommerce::handleMessage(const std::string& msg)
+/**
+ * @brief The dispatch table, sorted by name at compile time.
+ *
+ * A segment count of zero accepts any message with at least the four header
+ * segments. Mutating commands are written to the write-ahead log before they
+ * run. The position of an entry also selects its latency histogram.
+ */
+const std::array<eCommerce::CommandEntry, eCommerce::CommandCount>& eCommerce::commandTable()
+{
+    static constexpr std::array<CommandEntry, CommandCount> table = {{
+        { "addToCart",          6, true,  true,  &eCommerce::handleAddToCart },
+        { "addToWishlist",      5, true,  true,  &eCommerce::handleAddToWishlist },
+        { "batch",              4, true,  false, &eCommerce::handleBatch },
+        { "browseProducts",     0, true,  false, &eCommerce::handleBrowseProducts },
+        { "cancelOrder",        0, true,  true,  &eCommerce::cancelOrder },
+        { "checkout",           0, true,  true,  &eCommerce::checkout },
+        { "clearCart",          0, true,  true,  &eCommerce::handleClearCart },
+        { "heartbeat",          0, true,  false, &eCommerce::handleHeartbeat },
+        { "help",               0, true,  false, &eCommerce::handleHelp },
+        { "keepalive",          0, true,  false, &eCommerce::handleKeepalive },
+        { "pay",                0, true,  true,  &eCommerce::pay },
+        { "removeFromWishlist", 5, true,  true,  &eCommerce::handleRemoveFromWishlist },
+        { "removeItemFromCart", 6, true,  true,  &eCommerce::removeItemFromCart },
+        { "searchProducts",     0, true,  false, &eCommerce::handleSearchProducts },
+        { "start",              0, false, true,  &eCommerce::handleStart },
+        { "stats",              0, true,  false, &eCommerce::handleStats },
+        { "stop",               0, true,  true,  &eCommerce::stop },
+        { "suggest",            5, true,  false, &eCommerce::handleSuggest },
+        { "updateCartItem",     6, true,  true,  &eCommerce::updateCartItem },
+        { "viewCart",           0, true,  false, &eCommerce::handleViewCart },
+        { "viewOrders",         0, true,  false, &eCommerce::handleViewOrders },
+    }};
+
+    // Also catches a CommandCount larger than the table: the unnamed
+    // entries at the end would not sort after "viewOrders"
+    constexpr auto isSorted = [](const CommandEntry* begin, const CommandEntry* end) {
+        for (const CommandEntry* entry = begin + 1; entry < end; ++entry) {
+            if (!((entry - 1)->name < entry->name)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    static_assert(isSorted(table.data(), table.data() + table.size()), "commandTable must be sorted by name");
+    return table;
+}
+
+/**
+ * @brief Looks up a command in the dispatch table.
+ *
+ * The table is sorted by name, so a lookup costs a handful of comparisons
+ * however many commands are registered.
+ *
+ * @return The table entry, or nullptr for unknown commands.
+ */
+const eCommerce::CommandEntry* eCommerce::findCommand(std::string_view command)
 {
-    qCInfo(ecommercelog) << "Handling message:" << msg.c_str();
+    const auto& table = commandTable();
+    auto entry = std::lower_bound(table.begin(), table.end(), command,
+                                  [](const CommandEntry& entry, std::string_view name) { return entry.name < name; });
+    if (entry == table.end() || entry->name != command) {
+        return nullptr;
+    }
+    return &*entry;
+}
 
-    auto segments = splitMessage(msg, '>');
+const eCommerce::CommandEntry* eCommerce::handleMessage(Shard& shard, std::string_view msg)
+{
+    if (msg.substr(0, BinaryProtocol::RequestTopic.size()) == BinaryProtocol::RequestTopic) {
+        return handleBinaryMessage(shard, msg);
+    }
+
+    // Messages carry credentials, so they are only logged at debug level
+    qCDebug(ecommercelog) << "Handling message:" << msg;
+
+    MessageSegments segments = tokenizeMessage(msg, '>');
     if (segments.size() < 4) {
-        qCWarning(ecommercelog) << "Invalid message format:" << msg.c_str();
-        return;
+        qCWarning(ecommercelog) << "Invalid message format:" << msg;
+        return nullptr;
     }
+    return dispatchCommand(shard, segments);
+}
 
-    std::string username = segments[1];
-    std::string command = segments[2];
-    std::string password = segments[3];
+/**
+ * @brief Authenticates a binary request by its session and runs its command.
+ *
+ * The handlers read their arguments from text segments, so the varint
+ * arguments are formatted into a local buffer; the segments carry the
+ * stored password, which keeps the logged record replayable.
+ */
+const eCommerce::CommandEntry* eCommerce::handleBinaryMessage(Shard& shard, std::string_view msg)
+{
+    std::uint32_t globalUser;
+    std::uint64_t secret;
+    std::uint8_t opcode;
+    if (!BinaryProtocol::parseRequestHeader(msg, globalUser, secret, opcode)) {
+        qCWarning(ecommercelog) << "Invalid binary message header.";
+        return nullptr;
+    }
 
-    if (command == "start") {
-        if (segments.size() != 4) {
-            qCWarning(ecommercelog) << "Invalid start command format:" << msg.c_str();
-            return;
+    UserId user = static_cast<UserId>(globalUser / workerCount);
+    const BinaryProtocol::Command* command = BinaryProtocol::command(opcode);
+    std::string_view error;
+    if (globalUser % workerCount != shard.index || user >= shard.sessions.size()
+        || secret == 0 || shard.sessions[user] != secret) {
+        error = "Error: Invalid session.";
+    } else if (!command) {
+        error = "Error: Unknown opcode.";
+    }
+
+    MessageSegments segments;
+    std::array<char, 12> numbers[2];
+    if (error.empty())
+    {
+        segments.push_back("eCommerce?");
+        segments.push_back(shard.users.name(user));
+        segments.push_back(command->name);
+        segments.push_back(shard.passwords[user]);
+        for (std::size_t i = 0; i < command->arguments; ++i)
+        {
+            std::uint64_t value;
+            if (!BinaryProtocol::getVarint(msg, value) || value > static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
+                error = "Error: Invalid arguments.";
+                break;
+            }
+            char* end = std::to_chars(numbers[i].data(), numbers[i].data() + numbers[i].size(), value).ptr;
+            segments.push_back(std::string_view(numbers[i].data(), static_cast<std::size_t>(end - numbers[i].data())));
         }
-        qCInfo(ecommercelog) << "Setting password for user: " << username;
-        setUserPassword(username, password);
-        sendResponse(username, "start", getWelcomeMessage(), password);
-        return;
     }
 
-    qCInfo(ecommercelog) << "Verifying password for user: " << username;
-    if (!verifyUserPassword(username, password)) {
-        sendResponse(username, command, "Error: Incorrect password.", password);
-        return;
+    if (!error.empty()) {
+        qCInfo(ecommercelog) << "Rejected binary request for user ID" << globalUser << ":" << error.data();
+        BufferPool::Pointer response = messageBuffers.acquire();
+        BinaryProtocol::appendResponseHeader(response->data, globalUser, opcode, BinaryProtocol::Error);
+        response->data += error;
+        outbox.push(BufferPool::toMessage(std::move(response)));
+        return nullptr;
     }
 
-    if (command == "keepalive") {
-        return; // Skip logging and handling for this specific message
+    const CommandEntry* entry = findCommand(command->name);
+    Request request{ shard, user, segments[1], segments[2], segments[3], segments, nullptr, opcode };
+    runCommand(*entry, request);
+    return entry;
+}
+
+/**
+ * @brief The ID a user is known by outside its shard.
+ */
+std::uint32_t eCommerce::globalUserId(const Shard& shard, UserId user) const
+{
+    return static_cast<std::uint32_t>(user * workerCount + shard.index);
+}
+
+/**
+ * @brief Authenticates a tokenized command and runs its handler.
+ *
+ * Also used to replay the write-ahead log, in which case the shard is
+ * flagged as replaying: nothing is logged again and no responses are sent.
+ *
+ * @return The entry of the command that ran, nullptr if it was rejected.
+ */
+const eCommerce::CommandEntry* eCommerce::dispatchCommand(Shard& shard, const MessageSegments& segments)
+{
+    Request request{ shard, UserTable::NoUser, segments[1], segments[2], segments[3], segments };
+    const CommandEntry* entry = findCommand(request.command);
+
+    if (entry && !entry->authenticated) {
+        if (entry->segments != 0 && segments.size() != entry->segments) {
+            qCWarning(ecommercelog) << "Invalid" << request.command << "command format.";
+            return nullptr;
+        }
+        runCommand(*entry, request);
+        return entry;
     }
 
-    if (command == "browseProducts") {
-        sendResponse(username, "browseProducts", getBrowseProductsMessage(), password);
+    if (!authenticate(request)) {
+        sendError(request, "Incorrect password.");
+        return nullptr;
     }
-    else if (command == "addToCart" && segments.size() == 6)
-    {
-        handleAddToCart(username, segments, password);
+
+    if (!entry || (entry->segments != 0 && segments.size() != entry->segments)) {
+        qCWarning(ecommercelog) << "Unknown command:" << request.command;
+        return nullptr;
     }
-    else if (command == "clearCart")
-    {
-        handleClearCart(username, password);
+    runCommand(*entry, request);
+    return entry;
+}
+
+void eCommerce::runCommand(const CommandEntry& entry, Request& request)
+{
+    if (entry.mutating && wal.isOpen() && !request.shard.replaying) {
+        if (wal.hasFailed()) {
+            sendError(request, "The write-ahead log has failed; the command was not applied.");
+            return;
+        }
+        // Log the account password rather than a session token, which
+        // would not authenticate the record again after a restart
+        MessageSegments record;
+        for (std::size_t i = 0; i < request.segments.size(); ++i) {
+            bool password = i == 3 && request.user != UserTable::NoUser;
+            record.push_back(password ? std::string_view(request.shard.passwords[request.user]) : request.segments[i]);
+        }
+        // Group commit: the writer thread syncs this record together with
+        // whatever the other workers appended meanwhile
+        std::uint64_t lsn = wal.append(record, 1);
+        if (!request.batchResponse && !wal.waitDurable(lsn)) {
+            // The record may still have reached the file and be replayed
+            sendError(request, "The write-ahead log has failed; it is unknown whether the command survives a restart.");
+            return;
+        }
+        request.shard.appliedLsn = lsn;
     }
-    else if (command == "viewCart")
-    {
-        sendResponse(username, "viewCart", viewCart(username), password);
+    if (request.user != UserTable::NoUser && !request.shard.replaying) {
+        touchUser(request.shard, request.user);
     }
-    else if (command == "checkout")
-    {
-        checkout(username, password);
+    (this->*entry.handler)(request);
+}
+
+/**
+ * @brief Creates or logs in a user; "start>binary" opts into the binary protocol.
+ *
+ * A binary client only gets the bare session token, which holds the user ID
+ * and secret its binary requests are sent with.
+ */
+void eCommerce::handleStart(Request& request)
+{
+    bool binary = request.segments.size() == 5 && request.segments[4] == BinaryProtocol::StartOption;
+    if (request.segments.size() != 4 && !binary) {
+        qCWarning(ecommercelog) << "Invalid start command format.";
+        return;
     }
-    else if (command == "pay")
-    {
-        pay(username, password);
+    qCInfo(ecommercelog) << "Starting session for user: " << request.username;
+    setUserPassword(request);
+    if (!request.shard.replaying) {
+        touchUser(request.shard, request.user);
     }
-    else if (command == "viewOrders")
-    {
-        sendResponse(username, "viewOrders", viewOrders(username), password);
+    if (binary) {
+        sendResponse(request, startSession(request));
+        return;
     }
-    else if (command == "stop")
-    {
-        stop(username, password);
+    std::string message = "Your session token is " + startSession(request) + ". Use it in place of your password.\n";
+    message += getWelcomeMessage();
+    sendResponse(request, message);
+}
+
+void eCommerce::handleHelp(Request& request)
+{
+    sendResponse(request, getHelpMessage());
+}
+
+void eCommerce::handleKeepalive(Request&)
+{
+    // Skip logging and handling for this specific message
+}
+
+void eCommerce::handleHeartbeat(Request&)
+{
+    receiveHeartbeat();
+}
+
+/**
+ * @brief Sends the catalog, or only its version if the client's cached copy is current.
+ *
+ * The cached version is an optional argument; without it the full catalog
+ * is sent as before.
+ */
+void eCommerce::handleBrowseProducts(Request& request)
+{
+    std::shared_ptr<const CatalogResponse> response = std::atomic_load(&catalogResponse);
+    std::uint64_t cachedVersion = 0;
+    if (request.segments.size() > 4) {
+        std::string_view version = request.segments[4];
+        std::from_chars(version.data(), version.data() + version.size(), cachedVersion);
     }
-    else if (command == "heartbeat")
-    {
-        receiveHeartbeat();
+    if (cachedVersion != response->version) {
+        sendResponse(request, request.opcode ? response->binaryMessage : response->message);
+        return;
     }
-    else if (command == "updateCartItem" && segments.size() == 6)
-    {
-        updateCartItem(username, segments, password);
+    if (request.opcode) {
+        BufferPool::Pointer upToDate = beginResponse(request);
+        BinaryProtocol::putVarint(upToDate->data, response->version);
+        sendResponse(request, std::move(upToDate));
+    } else {
+        sendResponse(request, "Catalog version " + std::to_string(response->version) + " is up to date.");
     }
-    else if (command == "cancelOrder")
-    {
-        cancelOrder(username, password);
+}
+
+/**
+ * @brief Answers a name search from the product index.
+ *
+ * The optional limit caps the number of results, at most MaxSearchResults.
+ */
+void eCommerce::handleSearchProducts(Request& request)
+{
+    if (request.segments.size() < 5 || request.segments[4].empty()) {
+        sendError(request, "Missing search query.");
+        return;
     }
-    else if (command == "removeItemFromCart" && segments.size() == 6)
+    try
     {
-        removeItemFromCart(username, segments, password);
+        std::string_view query = request.segments[4];
+        int limit = DefaultSearchResults;
+        if (request.segments.size() > 5) {
+            limit = std::clamp(segmentToInt(request.segments[5]), 1, MaxSearchResults);
+        }
+
+        std::vector<ProductIndex::Match> matches = productIndex.search(query, static_cast<std::size_t>(limit), products);
+        if (matches.empty()) {
+            sendResponse(request, "No products match '" + std::string(query) + "'.");
+            return;
+        }
+        BufferPool::Pointer response = beginResponse(request);
+        std::string& results = response->data;
+        results += "Search results for '";
+        results += query;
+        results += "':\n";
+        for (const ProductIndex::Match& match : matches) {
+            results += std::to_string(match.productId);
+            results += ". ";
+            results += products.name(match.productId);
+            results += " - $";
+            Money::appendCents(results, products.priceCents(match.productId));
+            results += '\n';
+        }
+        sendResponse(request, std::move(response));
     }
-    else if (command == "addToWishlist" && segments.size() == 5)
+    catch (const std::exception& e)
     {
-        handleAddToWishlist(username, segments, password);
+        sendError(request, e.what());
     }
-    else if (command == "removeFromWishlist" && segments.size() == 5)
-    {
-        handleRemoveFromWishlist(username, segments, password);
+}
+
+/**
+ * @brief Answers a type-ahead prefix from the suggestion trie.
+ */
+void eCommerce::handleSuggest(Request& request)
+{
+    std::string_view prefix = request.segments[4];
+    std::vector<int> matches = suggestions.suggest(prefix);
+    BufferPool::Pointer response = beginResponse(request);
+    std::string& results = response->data;
+    results += "Suggestions for '";
+    results += prefix;
+    results += "':\n";
+    for (int productId : matches) {
+        results += std::to_string(productId);
+        results += ". ";
+        results += products.name(productId);
+        results += '\n';
     }
-    else
+    sendResponse(request, std::move(response));
+}
+
+void eCommerce::handleStats(Request& request)
+{
+    sendResponse(request, getStatsMessage());
+}
+
+/**
+ * @brief Runs the commands in the frames after the first, with one reply.
+ *
+ * The user is authenticated once for the whole batch and every command
+ * runs on this worker in frame order. Each logged command is its own log
+ * record, but the batch waits only once for all of them to be durable.
+ */
+void eCommerce::handleBatch(Request& request)
+{
+    Shard& shard = request.shard;
+    BufferPool::Pointer response = beginResponse(request);
+    std::string& results = response->data;
+
+    for (const zmq::message_t& frame : shard.batchFrames)
     {
-        qCWarning(ecommercelog) << "Unknown command:" << command.c_str();
+        MessageSegments args = tokenizeMessage(std::string_view(frame.data<char>(), frame.size()), '>');
+        if (args.empty()) {
+            continue;
+        }
+        results += args[0];
+        results += ": ";
+
+        // Rebuild the segments a standalone command would have had
+        MessageSegments segments;
+        segments.push_back(request.segments[0]);
+        segments.push_back(request.username);
+        segments.push_back(args[0]);
+        segments.push_back(request.password);
+        for (std::size_t i = 1; i < args.size() && !segments.full(); ++i) {
+            segments.push_back(args[i]);
+        }
+
+        const CommandEntry* entry = findCommand(args[0]);
+        if (!entry || !entry->authenticated || entry->handler == &eCommerce::handleBatch
+            || (entry->segments != 0 && segments.size() != entry->segments)) {
+            results += "Error: Invalid command.\n";
+            continue;
+        }
+        Request command{ shard, request.user, request.username, args[0], request.password, segments, &results };
+        runCommand(*entry, command);
+        if (results.back() != '\n') {
+            results += '\n';
+        }
     }
+
+    // The commands already ran, so a failed log can only be reported
+    if (wal.isOpen() && !shard.replaying && !wal.waitDurable(shard.appliedLsn)) {
+        sendError(request, "The write-ahead log has failed; it is unknown whether the results of this batch survive a restart.");
+        return;
+    }
+    sendResponse(request, std::move(response));
 }
 
-std::vector<std::string> eCommerce::splitMessage(const std::string& msg, char delimiter)
+void eCommerce::handleViewCart(Request& request)
 {
-    std::stringstream ss(msg);
-    std::string segment;
-    std::vector<std::string> segments;
-    while (std::getline(ss, segment, delimiter))
-    {
-        segments.push_back(segment);
+    BufferPool::Pointer response = beginResponse(request);
+    if (request.opcode) {
+        putCart(response->data, request.shard.carts[request.user]);
+    } else {
+        viewCart(request, response->data);
     }
-    return segments;
+    sendResponse(request, std::move(response));
 }
 
-void eCommerce::setUserPassword(const std::string& username, const std::string& password)
+void eCommerce::handleViewOrders(Request& request)
 {
-    std::lock_guard<std::mutex> lock(passwordMutex);
-    qCInfo(ecommercelog) << "Setting password for user: " << username << " Password: " << password;
-    userPasswords[username] = password;
+    BufferPool::Pointer response = beginResponse(request);
+    if (request.opcode) {
+        const std::vector<Cart>& userOrders = request.shard.orders[request.user];
+        BinaryProtocol::putVarint(response->data, request.shard.paid[request.user]);
+        BinaryProtocol::putVarint(response->data, userOrders.size());
+        for (const Cart& order : userOrders) {
+            putCart(response->data, order);
+        }
+    } else {
+        viewOrders(request, response->data);
+    }
+    sendResponse(request, std::move(response));
 }
 
-bool eCommerce::verifyUserPassword(const std::string& username, const std::string& password)
+/**
+ * @brief Interns the user on first use and sets their password.
+ */
+void eCommerce::setUserPassword(Request& request)
 {
-    std::lock_guard<std::mutex> lock(passwordMutex);
-    if (userPasswords.find(username) == userPasswords.end()) {
-        qCInfo(ecommercelog) << "Password verification failed: User not found";
+    request.user = request.shard.addUser(request.username);
+    request.shard.passwords[request.user] = request.password;
+}
+
+bool eCommerce::verifyUserPassword(const Request& request)
+{
+    return request.user != UserTable::NoUser && request.shard.passwords[request.user] == request.password;
+}
+
+/**
+ * @brief Starts a new session for the user, ending any previous one.
+ *
+ * @return The token to send in place of the password.
+ */
+std::string eCommerce::startSession(const Request& request)
+{
+    std::uint64_t secret;
+    do {
+        secret = request.shard.sessionSecrets();
+    } while (secret == 0);
+    request.shard.sessions[request.user] = secret;
+    return SessionToken::format(globalUserId(request.shard, request.user), secret);
+}
+
+/**
+ * @brief Checks the credential segment and resolves the user of a request.
+ *
+ * A session token carries the user's ID, so it is checked with two array
+ * reads and a name comparison; anything else is looked up and compared as
+ * a password.
+ */
+bool eCommerce::authenticate(Request& request)
+{
+    Shard& shard = request.shard;
+    std::uint32_t globalUser;
+    std::uint64_t secret;
+    if (SessionToken::parse(request.password, globalUser, secret) && globalUser % workerCount == shard.index) {
+        UserId user = static_cast<UserId>(globalUser / workerCount);
+        if (user < shard.sessions.size() && secret != 0 && shard.sessions[user] == secret
+            && shard.users.name(user) == request.username) {
+            request.user = user;
+            return true;
+        }
+    }
+
+    request.user = shard.users.find(request.username);
+    if (!verifyUserPassword(request)) {
+        qCInfo(ecommercelog) << "Authentication failed for user: " << request.username;
         return false;
     }
-    qCInfo(ecommercelog) << "Stored password: " << userPasswords[username] << " Provided password: " << password;
-    return userPasswords[username] == password;
+    return true;
 }
 
-void eCommerce::handleAddToCart(const std::string& username, const std::vector<std::string>& segments, const std::string& password)
+void eCommerce::handleAddToCart(Request& request)
 {
     try
     {
-        int productId = std::stoi(segments[4]);
-        int quantity = std::stoi(segments[5]);
+        int productId = segmentToInt(request.segments[4]);
+        int quantity = segmentToInt(request.segments[5]);
         validateAddToCartInput(productId, quantity);
-        if (products.find(productId) != products.end()) {
-            addToCart(username, productId, quantity);
-            sendResponse(username, "addToCart", "Added product " + std::to_string(productId) + " to cart with quantity " + std::to_string(quantity), password);
+        if (products.contains(productId)) {
+            addToCart(request, productId, quantity);
+            sendResponse(request, "Added product " + std::to_string(productId) + " to cart with quantity " + std::to_string(quantity));
         } else {
-            sendResponse(username, "addToCart", "Error: Product ID " + std::to_string(productId) + " does not exist.", password);
+            sendError(request, "Product ID " + std::to_string(productId) + " does not exist.");
         }
     }
     catch (const std::exception& e)
     {
-        sendResponse(username, "addToCart", "Error: " + std::string(e.what()), password);
+        sendError(request, e.what());
     }
 }
 
@@ -287,24 +1366,24 @@ void eCommerce::validateAddToCartInput(int productId, int quantity)
     }
 }
 
-void eCommerce::handleClearCart(const std::string& username, const std::string& password)
+void eCommerce::handleClearCart(Request& request)
 {
-    std::lock_guard<std::mutex> lock(cartMutex);
-    if (userCarts.find(username) == userCarts.end() || userCarts[username].empty())
+    Cart& cart = request.shard.carts[request.user];
+    if (cart.empty())
     {
-        sendResponse(username, "clearCart", "Error: Your cart is already empty.", password);
+        sendError(request, "Your cart is already empty.");
     }
     else
     {
-        userCarts.erase(username);
-        sendResponse(username, "clearCart", "Your cart has been cleared.", password);
+        cart = Cart();
+        sendResponse(request, "Your cart has been cleared.");
     }
 }
 
 std::string eCommerce::getHelpMessage()
 {
     return "Available commands:\n"
-           "1. browseProducts <password> - Display a list of available products.\n"
+           "1. browseProducts <password> [catalog version] - Display a list of available products, or only confirm that your cached catalog version is current.\n"
            "2. addToCart <password> <productId> <quantity> - Add a product to the shopping cart.\n"
            "3. clearCart <password> - Clear the entire shopping cart.\n"
            "4. viewCart <password> - View the contents of the shopping cart.\n"
@@ -316,7 +1395,11 @@ std::string eCommerce::getHelpMessage()
            "10. cancelOrder <password> - Cancel orders placed in the checkout but not yet paid.\n"
            "11. removeItemFromCart <password> <productId> <quantity> - Remove a specified quantity of a product from the cart.\n"
            "12. addToWishlist <password> <productId> - Add a product to the wishlist.\n"
-           "13. removeFromWishlist <password> <productId> - Remove a product from the wishlist.\n";
+           "13. removeFromWishlist <password> <productId> - Remove a product from the wishlist.\n"
+           "14. stats <password> - Show per-command counts and latency percentiles.\n"
+           "15. batch <password> - Run the commands in the following message frames, e.g. 'addToCart>1>2', with one reply.\n"
+           "16. searchProducts <password> <query> [limit] - Find products whose name contains every word of the query, best matches first.\n"
+           "17. suggest <password> <prefix> - Suggest products with a word starting with the prefix, for type-ahead.\n";
 }
 
 std::string eCommerce::getWelcomeMessage()
@@ -325,7 +1408,7 @@ std::string eCommerce::getWelcomeMessage()
            "We are delighted to have you on board.\n"
            "This system allows you to browse products, add them to your cart, and make purchases with ease.\n"
            "To get started, you can use the following commands:\n"
-           "1. browseProducts <password> - Display a list of available products.\n"
+           "1. browseProducts <password> [catalog version] - Display a list of available products, or only confirm that your cached catalog version is current.\n"
            "2. addToCart <password> <productId> <quantity> - Add a product to the shopping cart.\n"
            "3. clearCart <password> - Clear the entire shopping cart.\n"
            "4. viewCart <password> - View the contents of the shopping cart.\n"
@@ -338,238 +1421,392 @@ std::string eCommerce::getWelcomeMessage()
            "11. removeItemFromCart <password> <productId> <quantity> - Remove a specified quantity of a product from the cart.\n"
            "12. addToWishlist <password> <productId> - Add a product to the wishlist.\n"
            "13. removeFromWishlist <password> <productId> - Remove a product from the wishlist.\n"
+           "14. searchProducts <password> <query> [limit] - Find products by name.\n"
+           "15. suggest <password> <prefix> - Suggest products as you type.\n"
            "If you need any assistance, please use the 'help' command or contact our support team.\n"
            "Happy shopping!";
 }
 
+/**
+ * @brief The browseProducts payload of the binary protocol.
+ */
+std::string eCommerce::getBrowseProductsPayload()
+{
+    std::string payload;
+    BinaryProtocol::putVarint(payload, products.size());
+    products.forEach([&payload](int id, std::string_view name, std::int64_t priceCents) {
+        BinaryProtocol::putVarint(payload, static_cast<std::uint64_t>(id));
+        BinaryProtocol::putVarint(payload, static_cast<std::uint64_t>(priceCents));
+        BinaryProtocol::putVarint(payload, name.size());
+        payload += name;
+    });
+    return payload;
+}
+
 std::string eCommerce::getBrowseProductsMessage()
 {
-    std::string productsMsg = "Available products:\n";
-    for (const auto& product : products) {
-        productsMsg += std::to_string(product.first) + ". " + product.second.first + " - $" + std::to_string(product.second.second) + "\n";
-    }
+    std::string productsMsg;
+    products.forEach([&productsMsg](int id, std::string_view name, std::int64_t priceCents) {
+        productsMsg += std::to_string(id);
+        productsMsg += ". ";
+        productsMsg += name;
+        productsMsg += " - $";
+        Money::appendCents(productsMsg, priceCents);
+        productsMsg += '\n';
+    });
     return productsMsg;
 }
 
-void eCommerce::addToCart(const std::string& username, int productId, int quantity)
+void eCommerce::addToCart(const Request& request, int productId, int quantity)
 {
-    std::lock_guard<std::mutex> lock(cartMutex);
-    if (products.find(productId) != products.end()) {
-        userCarts[username][productId] += quantity;
+    if (products.contains(productId)) {
+        request.shard.carts[request.user].add(productId, quantity, products.priceCents(productId));
     }
 }
 
-std::string eCommerce::viewCart(const std::string& username)
+/**
+ * @brief Merges the latency histograms of all shards into a per-command table.
+ *
+ * Latencies run from a worker picking a command up until its handler
+ * returned, including the write-ahead log sync and sending the response.
+ */
+std::string eCommerce::getStatsMessage()
 {
-    std::lock_guard<std::mutex> lock(cartMutex);
-    std::string cartMsg = "Cart contents for " + username + ":\n";
-    double total = 0.0;
-    if (userCarts.find(username) != userCarts.end()) {
-        for (const auto& item : userCarts[username]) {
-            cartMsg += products[item.first].first + " - Quantity: " + std::to_string(item.second) + " - $" + std::to_string(products[item.first].second * item.second) + "\n";
-            total += products[item.first].second * item.second;
+    double uptime = std::chrono::duration<double>(TimerWheel::Clock::now() - startTime).count();
+    char line[160];
+    std::snprintf(line, sizeof(line), "Command statistics over %.0f s (latencies in microseconds):\n", uptime);
+    std::string statsMsg = line;
+    std::snprintf(line, sizeof(line), "%-20s %10s %10s %10s %10s %10s %10s\n", "command", "count", "per s", "p50", "p99", "p99.9", "max");
+    statsMsg += line;
+
+    auto micros = [](std::uint64_t nanos) { return static_cast<double>(nanos) / 1000.0; };
+    const auto& table = commandTable();
+    for (std::size_t command = 0; command < table.size(); ++command)
+    {
+        LatencyHistogram::Counts counts;
+        for (const auto& shard : shards) {
+            shard->stats.latencies[command].mergeInto(counts);
+        }
+        if (counts.total == 0) {
+            continue;
         }
+        std::snprintf(line, sizeof(line), "%-20.*s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                      static_cast<int>(table[command].name.size()), table[command].name.data(),
+                      static_cast<unsigned long long>(counts.total),
+                      uptime > 0 ? static_cast<double>(counts.total) / uptime : 0.0,
+                      micros(counts.percentile(0.5)), micros(counts.percentile(0.99)),
+                      micros(counts.percentile(0.999)), micros(counts.max()));
+        statsMsg += line;
     }
-    cartMsg += "Total: $" + std::to_string(total) + "\n";
-    return cartMsg;
+    return statsMsg;
 }
 
-void eCommerce::checkout(const std::string& username, const std::string& password)
+/**
+ * @brief Replaces the statistics file with the current command statistics.
+ */
+void eCommerce::writeStatsFile()
 {
-    std::lock_guard<std::mutex> lock(cartMutex);
+    if (config.statsPath.empty()) {
+        return;
+    }
+    std::string statsMsg = getStatsMessage();
+    QSaveFile file(QString::fromStdString(config.statsPath));
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(statsMsg.data(), static_cast<qint64>(statsMsg.size())) != static_cast<qint64>(statsMsg.size())
+        || !file.commit()) {
+        qCWarning(ecommercelog) << "Cannot write statistics file" << config.statsPath.c_str() << ":" << file.errorString();
+    }
+}
 
-    if (userCarts.find(username) == userCarts.end() || userCarts[username].empty()) {
-        if (userWishlists.find(username) != userWishlists.end() && !userWishlists[username].empty()) {
-            for (const auto& productId : userWishlists[username]) {
-                userCarts[username][productId] = 1;
-            }
-            userWishlists.erase(username);
+void eCommerce::viewCart(const Request& request, std::string& out)
+{
+    const Cart& cart = request.shard.carts[request.user];
+    out += "Cart contents for ";
+    out += request.username;
+    out += ":\n";
+    appendLineItems(out, cart);
+    out += "Total: $";
+    Money::appendCents(out, cart.total());
+    out += '\n';
+}
+
+/**
+ * @brief Appends one "<name> - Quantity: <n> - $<amount>" line per item.
+ */
+void eCommerce::appendLineItems(std::string& out, const Cart& cart)
+{
+    for (std::size_t line = 0; line < cart.size(); ++line) {
+        out += products.name(cart.productId(line));
+        out += " - Quantity: ";
+        out += std::to_string(cart.quantity(line));
+        out += " - $";
+        Money::appendCents(out, cart.lineTotal(line));
+        out += '\n';
+    }
+}
+
+void eCommerce::checkout(Request& request)
+{
+    Shard& shard = request.shard;
+    Cart& cart = shard.carts[request.user];
+    std::set<int>& wishlist = shard.wishlists[request.user];
+    if (cart.empty() && !wishlist.empty()) {
+        for (const auto& productId : wishlist) {
+            cart.add(productId, 1, products.priceCents(productId));
         }
+        wishlist.clear();
     }
 
-    if (userCarts.find(username) != userCarts.end() && !userCarts[username].empty()) {
-        std::string wishlistMsg = checkWishlist(username);
+    if (!cart.empty()) {
+        std::string wishlistMsg = checkWishlist(request);
         if (!wishlistMsg.empty()) {
-            sendResponse(username, "checkout", "You have items in your wishlist that are not in your cart:\n" + wishlistMsg, password);
+            sendResponse(request, "You have items in your wishlist that are not in your cart:\n" + wishlistMsg);
             return;
         }
-        orders[username].push_back(userCarts[username]);
-        userCarts.erase(username);
-        userPaymentStatus[username] = false;
-        sendResponse(username, "checkout", "Your order has been placed successfully. Please proceed to payment.", password);
+        shard.orders[request.user].push_back(std::move(cart));
+        cart = Cart();
+        shard.paid[request.user] = 0;
+        sendResponse(request, "Your order has been placed successfully. Please proceed to payment.");
     } else {
-        sendResponse(username, "checkout", "Your cart is empty. Cannot place an order.", password);
+        sendResponse(request, "Your cart is empty. Cannot place an order.");
     }
 }
 
-void eCommerce::pay(const std::string& username, const std::string& password)
+void eCommerce::pay(Request& request)
 {
-    std::lock_guard<std::mutex> lock(cartMutex);
-    if (orders.find(username) != orders.end() && !orders[username].empty())
+    if (!request.shard.orders[request.user].empty())
     {
-        userPaymentStatus[username] = true;
-        sendResponse(username, "pay", "Your payment has been received. Thank you for your purchase!", password);
+        request.shard.paid[request.user] = 1;
+        sendResponse(request, "Your payment has been received. Thank you for your purchase!");
     }
     else
     {
-        sendResponse(username, "pay", "No pending orders to pay for.", password);
+        sendResponse(request, "No pending orders to pay for.");
     }
 }
 
-std::string eCommerce::viewOrders(const std::string& username)
+void eCommerce::viewOrders(const Request& request, std::string& out)
 {
-    std::lock_guard<std::mutex> lock(cartMutex);
-    std::string ordersMsg = "Past orders for " + username + ":\n";
-    if (orders.find(username) != orders.end()) {
+    out += "Past orders for ";
+    out += request.username;
+    out += ":\n";
+    const std::vector<Cart>& userOrders = request.shard.orders[request.user];
+    if (!userOrders.empty()) {
+        bool paid = request.shard.paid[request.user] != 0;
         int orderNumber = 1;
-        for (const auto& order : orders[username]) {
-            ordersMsg += "Order " + std::to_string(orderNumber++) + ":\n";
-            double total = 0.0;
-            for (const auto& item : order) {
-                ordersMsg += products[item.first].first + " - Quantity: " + std::to_string(item.second) + " - $" + std::to_string(products[item.first].second * item.second) + "\n";
-                total += products[item.first].second * item.second;
-            }
-            ordersMsg += "Total: $" + std::to_string(total) + "\n";
-            ordersMsg += "Payment Status: " + std::string(userPaymentStatus[username] ? "Paid" : "Pending") + "\n";
+        for (const auto& order : userOrders) {
+            out += "Order " + std::to_string(orderNumber++) + ":\n";
+            appendLineItems(out, order);
+            out += "Total: $";
+            Money::appendCents(out, order.total());
+            out += '\n';
+            out += "Payment Status: " + std::string(paid ? "Paid" : "Pending") + "\n";
         }
     } else {
-        ordersMsg += "No orders found.\n";
+        out += "No orders found.\n";
     }
-    return ordersMsg;
 }
 
-void eCommerce::stop(const std::string& username, const std::string& password)
+void eCommerce::stop(Request& request)
 {
-    std::lock_guard<std::mutex> lock(cartMutex);
-    userCarts.erase(username);
-    userPaymentStatus.erase(username);
-    sendResponse(username, "stop", "User " + username + " has been logged out and their cart has been cleared.", password);
+    request.shard.carts[request.user] = Cart();
+    request.shard.paid[request.user] = 0;
+    request.shard.sessions[request.user] = 0;
+    request.shard.timers.cancel(request.shard.idleTimers[request.user]);
+    request.shard.idleTimers[request.user] = TimerWheel::NoTimer;
+    std::string message = "User ";
+    message += request.username;
+    message += " has been logged out and their cart has been cleared.";
+    sendResponse(request, message);
 }
 
-void eCommerce::updateCartItem(const std::string& username, const std::vector<std::string>& segments, const std::string& password)
+void eCommerce::updateCartItem(Request& request)
 {
     try
     {
-        int productId = std::stoi(segments[4]);
-        int quantity = std::stoi(segments[5]);
+        int productId = segmentToInt(request.segments[4]);
+        int quantity = segmentToInt(request.segments[5]);
         validateAddToCartInput(productId, quantity);
-        std::lock_guard<std::mutex> lock(cartMutex);
-        if (products.find(productId) != products.end() && userCarts[username].find(productId) != userCarts[username].end()) {
-            userCarts[username][productId] = quantity;
-            sendResponse(username, "updateCartItem", "Updated product " + std::to_string(productId) + " to quantity " + std::to_string(quantity), password);
+        Cart& cart = request.shard.carts[request.user];
+        std::size_t line = cart.find(productId);
+        if (products.contains(productId) && line != Cart::npos) {
+            cart.setQuantity(line, quantity);
+            sendResponse(request, "Updated product " + std::to_string(productId) + " to quantity " + std::to_string(quantity));
         } else {
-            sendResponse(username, "updateCartItem", "Error: Product ID " + std::to_string(productId) + " does not exist in your cart.", password);
+            sendError(request, "Product ID " + std::to_string(productId) + " does not exist in your cart.");
         }
     }
     catch (const std::exception& e)
     {
-        sendResponse(username, "updateCartItem", "Error: " + std::string(e.what()), password);
+        sendError(request, e.what());
     }
 }
 
-void eCommerce::cancelOrder(const std::string& username, const std::string& password)
+void eCommerce::cancelOrder(Request& request)
 {
-    std::lock_guard<std::mutex> lock(cartMutex);
-    if (orders.find(username) != orders.end() && !orders[username].empty() && !userPaymentStatus[username]) {
-        orders[username].pop_back();
-        sendResponse(username, "cancelOrder", "Your last order has been cancelled.", password);
+    std::vector<Cart>& userOrders = request.shard.orders[request.user];
+    if (!userOrders.empty() && !request.shard.paid[request.user]) {
+        userOrders.pop_back();
+        sendResponse(request, "Your last order has been cancelled.");
     } else {
-        sendResponse(username, "cancelOrder", "No orders to cancel or the order has already been paid.", password);
+        sendResponse(request, "No orders to cancel or the order has already been paid.");
     }
 }
 
-void eCommerce::removeItemFromCart(const std::string& username, const std::vector<std::string>& segments, const std::string& password)
+void eCommerce::removeItemFromCart(Request& request)
 {
     try
     {
-        int productId = std::stoi(segments[4]);
-        int quantity = std::stoi(segments[5]);
-        std::lock_guard<std::mutex> lock(cartMutex);
-        if (userCarts[username].find(productId) != userCarts[username].end()) {
-            if (userCarts[username][productId] >= quantity) {
-                userCarts[username][productId] -= quantity;
-                if (userCarts[username][productId] == 0) {
-                    userCarts[username].erase(productId);
+        int productId = segmentToInt(request.segments[4]);
+        int quantity = segmentToInt(request.segments[5]);
+        Cart& cart = request.shard.carts[request.user];
+        std::size_t line = cart.find(productId);
+        if (line != Cart::npos) {
+            if (cart.quantity(line) >= quantity) {
+                cart.setQuantity(line, cart.quantity(line) - quantity);
+                if (cart.quantity(line) == 0) {
+                    cart.erase(line);
                 }
-                sendResponse(username, "removeItemFromCart", "Removed " + std::to_string(quantity) + " of product " + std::to_string(productId) + " from cart.", password);
+                sendResponse(request, "Removed " + std::to_string(quantity) + " of product " + std::to_string(productId) + " from cart.");
             } else {
-                sendResponse(username, "removeItemFromCart", "Error: Not enough quantity to remove.", password);
+                sendError(request, "Not enough quantity to remove.");
             }
         } else {
-            sendResponse(username, "removeItemFromCart", "Error: Product ID " + std::to_string(productId) + " does not exist in your cart.", password);
+            sendError(request, "Product ID " + std::to_string(productId) + " does not exist in your cart.");
         }
     }
     catch (const std::exception& e)
     {
-        sendResponse(username, "removeItemFromCart", "Error: " + std::string(e.what()), password);
+        sendError(request, e.what());
     }
 }
 
-void eCommerce::handleAddToWishlist(const std::string& username, const std::vector<std::string>& segments, const std::string& password)
+void eCommerce::handleAddToWishlist(Request& request)
 {
     try
     {
-        int productId = std::stoi(segments[4]);
-        std::lock_guard<std::mutex> lock(wishlistMutex);
-        if (products.find(productId) != products.end()) {
-            userWishlists[username].insert(productId);
-            sendResponse(username, "addToWishlist", "Added product " + std::to_string(productId) + " to wishlist.", password);
+        int productId = segmentToInt(request.segments[4]);
+        if (products.contains(productId)) {
+            request.shard.wishlists[request.user].insert(productId);
+            sendResponse(request, "Added product " + std::to_string(productId) + " to wishlist.");
         } else {
-            sendResponse(username, "addToWishlist", "Error: Product ID " + std::to_string(productId) + " does not exist.", password);
+            sendError(request, "Product ID " + std::to_string(productId) + " does not exist.");
         }
     }
     catch (const std::exception& e)
     {
-        sendResponse(username, "addToWishlist", "Error: " + std::string(e.what()), password);
+        sendError(request, e.what());
     }
 }
 
-void eCommerce::handleRemoveFromWishlist(const std::string& username, const std::vector<std::string>& segments, const std::string& password)
+void eCommerce::handleRemoveFromWishlist(Request& request)
 {
     try
     {
-        int productId = std::stoi(segments[4]);
-        std::lock_guard<std::mutex> lock(wishlistMutex);
-        if (products.find(productId) != products.end()) {
-            if (userWishlists[username].erase(productId)) {
-                sendResponse(username, "removeFromWishlist", "Removed product " + std::to_string(productId) + " from wishlist.", password);
+        int productId = segmentToInt(request.segments[4]);
+        if (products.contains(productId)) {
+            if (request.shard.wishlists[request.user].erase(productId)) {
+                sendResponse(request, "Removed product " + std::to_string(productId) + " from wishlist.");
             } else {
-                sendResponse(username, "removeFromWishlist", "Error: Product ID " + std::to_string(productId) + " does not exist in your wishlist.", password);
+                sendError(request, "Product ID " + std::to_string(productId) + " does not exist in your wishlist.");
             }
         } else {
-            sendResponse(username, "removeFromWishlist", "Error: Product ID " + std::to_string(productId) + " does not exist.", password);
+            sendError(request, "Product ID " + std::to_string(productId) + " does not exist.");
         }
     }
     catch (const std::exception& e)
     {
-        sendResponse(username, "removeFromWishlist", "Error: " + std::string(e.what()), password);
+        sendError(request, e.what());
     }
 }
 
-std::string eCommerce::checkWishlist(const std::string& username)
+std::string eCommerce::checkWishlist(const Request& request)
 {
-    std::lock_guard<std::mutex> lock(wishlistMutex);
     std::string wishlistMsg;
-    if (userWishlists.find(username) != userWishlists.end()) {
-        for (int productId : userWishlists[username]) {
-            if (userCarts[username].find(productId) == userCarts[username].end()) {
-                wishlistMsg += products[productId].first + "\n";
-            }
+    const Cart& cart = request.shard.carts[request.user];
+    for (int productId : request.shard.wishlists[request.user]) {
+        if (cart.find(productId) == Cart::npos) {
+            wishlistMsg += products.name(productId);
+            wishlistMsg += '\n';
         }
     }
     return wishlistMsg;
 }
 
 /**
- * @brief Sends a response message to the client.
+ * @brief Returns a pooled buffer holding the header of the response to a request.
  *
- * @param username The username of the client.
- * @param command The command being responded to.
- * @param message The response message content.
- * @param password The password of the user for verification.
+ * The handler appends the response body in place and passes the buffer to
+ * sendResponse(), so the formatted body is never copied again.
+ */
+BufferPool::Pointer eCommerce::beginResponse(const Request& request, BinaryProtocol::Status status)
+{
+    BufferPool::Pointer response = messageBuffers.acquire();
+    if (request.batchResponse) {
+        return response;
+    }
+    if (request.opcode) {
+        BinaryProtocol::appendResponseHeader(response->data, globalUserId(request.shard, request.user), request.opcode, status);
+        return response;
+    }
+    std::string& data = response->data;
+    data += "eCommerce!>";
+    data += request.username;
+    data += '>';
+    data += request.command;
+    data += '>';
+    data += request.password;
+    data += '>';
+    return response;
+}
+
+/**
+ * @brief Hands a response started by beginResponse() to the sender thread.
  */
-void eCommerce::sendResponse(const std::string& username, const std::string& command, const std::string& message, const std::string& password)
+void eCommerce::sendResponse(const Request& request, BufferPool::Pointer response)
 {
-    std::string response = "eCommerce!>" + username + ">" + command + ">" + password + ">" + message;
-    pusher.send(zmq::buffer(response), zmq::send_flags::none);
+    if (request.shard.replaying) {
+        return;
+    }
+    if (request.batchResponse) {
+        *request.batchResponse += response->data;
+        return;
+    }
+    outbox.push(BufferPool::toMessage(std::move(response)));
+}
+
+/**
+ * @brief Sends the response to a request back to its client.
+ */
+void eCommerce::sendResponse(const Request& request, std::string_view message)
+{
+    if (request.shard.replaying) {
+        return;
+    }
+    if (request.batchResponse) {
+        *request.batchResponse += message;
+        return;
+    }
+    BufferPool::Pointer response = beginResponse(request);
+    response->data += message;
+    sendResponse(request, std::move(response));
+}
+
+/**
+ * @brief Sends "Error: <message>"; binary clients also get the error status.
+ */
+void eCommerce::sendError(const Request& request, std::string_view message)
+{
+    if (request.shard.replaying) {
+        return;
+    }
+    if (request.batchResponse) {
+        *request.batchResponse += "Error: ";
+        *request.batchResponse += message;
+        return;
+    }
+    BufferPool::Pointer response = beginResponse(request, BinaryProtocol::Error);
+    response->data += "Error: ";
+    response->data += message;
+    sendResponse(request, std::move(response));
 }
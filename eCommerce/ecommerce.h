@@ -1,83 +1,323 @@
 #ifndef ECOMMERCE_H
 #define ECOMMERCE_H
 
+#include <array>
 #include <map>
+#include <memory>
+#include <random>
 #include <set>
 #include <string>
 #include <vector>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
 #include <zmq.hpp>
+#include "binaryprotocol.h"
+#include "broker.h"
+#include "bufferpool.h"
+#include "cart.h"
+#include "latencyhistogram.h"
+#include "messagetokenizer.h"
+#include "mpscqueue.h"
+#include "productcatalog.h"
+#include "productindex.h"
+#include "snapshotstore.h"
+#include "suggesttrie.h"
+#include "timerwheel.h"
+#include "usertable.h"
+#include "writeaheadlog.h"
 #include <QCoreApplication>
 #include <QLoggingCategory>
 
 Q_DECLARE_LOGGING_CATEGORY(ecommercelog)
 Q_DECLARE_LOGGING_CATEGORY(heartbeatlog)
 
+/**
+ * @brief Start-up settings of the eCommerce server.
+ */
+struct ServerConfig {
+    std::size_t workerCount = 0;    // 0 picks eCommerce::defaultWorkerCount()
+    std::string catalogPath;        // binary catalog file; empty uses the built-in products
+    std::chrono::seconds catalogInterval{60};   // period of the catalog broadcast
+    std::string walPath;            // write-ahead log file; empty keeps all state in memory only
+    WriteAheadLog::SyncPolicy walSyncPolicy = WriteAheadLog::SyncPolicy::Batch;
+    std::chrono::milliseconds walSyncInterval{1000};
+    std::string snapshotPath;       // snapshot file; only used together with the write-ahead log
+    std::chrono::seconds snapshotInterval{300};
+    std::chrono::minutes sessionTimeout{30};    // idle time after which a session token expires
+    std::chrono::minutes cartTimeout{24 * 60};  // idle time after which a cart counts as abandoned
+    std::chrono::minutes accountTimeout{30 * 24 * 60};  // idle time after which an account with nothing to keep is forgotten
+    std::string statsPath;          // file the command statistics are written to every minute; empty for none
+    std::string pushEndpoint = "tcp://benternet.pxl-ea-ict.be:24041";     // broker endpoint responses are pushed to
+    std::string subscribeEndpoint = "tcp://benternet.pxl-ea-ict.be:24042"; // broker endpoint commands are received from
+    bool embeddedBroker = false;    // bind a Broker on both endpoints inside the server process
+};
+
 class eCommerce {
 public:
-    eCommerce(QCoreApplication *a);
+    eCommerce(QCoreApplication *a, const ServerConfig& config = ServerConfig());
     ~eCommerce();
 
     void sendHeartbeat();
     void receiveHeartbeat();
 
+    static std::size_t defaultWorkerCount();
+
 private:
+    BufferPool messageBuffers;      // declared first: messages in flight outlive everything else
     zmq::context_t context;
     zmq::socket_t subscriber;
     zmq::socket_t pusher;
+    zmq::socket_t wakeupReceiver;
+    zmq::socket_t wakeupSender;
+    std::unique_ptr<Broker> broker;
+
+    static constexpr std::size_t CommandCount = 21;
+
+    /**
+     * @brief Contention counters and command latencies of one shard.
+     *
+     * Written by the dispatcher and the owning worker, read by the server
+     * thread for the periodic statistics log and by the stats command.
+     * holdNanos is the time the worker held the shard's state while handling
+     * commands; no other thread ever waits for it. latencies has one
+     * histogram per dispatch table entry.
+     */
+    struct ShardStats {
+        std::atomic<std::uint64_t> dispatched{0};
+        std::atomic<std::uint64_t> handled{0};
+        std::atomic<std::uint64_t> maxQueueDepth{0};
+        std::atomic<std::uint64_t> holdNanos{0};
+        std::array<LatencyHistogram, CommandCount> latencies;
+    };
+
+    using UserId = UserTable::UserId;
+
+    /**
+     * @brief User state owned by exactly one worker thread.
+     *
+     * Users are assigned to shards by workerFor(), so only the owning worker
+     * ever touches this state and it needs no locking. A user is interned
+     * by start; all per-user vectors are indexed by the resulting ID, which
+     * is reused once the account has been forgotten.
+     */
+    struct Shard {
+        std::size_t index = 0;
+        UserTable users;
+        std::vector<std::string> passwords;
+        std::vector<Cart> carts;
+        std::vector<std::vector<Cart>> orders;
+        std::vector<std::uint8_t> paid;     // payment status of the orders
+        std::vector<std::set<int>> wishlists;
+        std::vector<std::uint64_t> sessions;    // secret of the current session, 0 when logged out
+        std::vector<TimerWheel::Clock::time_point> lastActive;
+        std::vector<TimerWheel::TimerId> idleTimers;
+        std::mt19937_64 sessionSecrets{std::random_device{}()};
+        TimerWheel timers;                      // idle timers, the payload is the user ID
+        TimerWheel::Clock::time_point now;      // time the current command was picked up
+        bool replaying = false;
+        std::vector<zmq::message_t> batchFrames;    // frames after the first of the message being handled
+        std::uint64_t appliedLsn = 0;   // last logged command applied to this shard
+        ShardStats stats;
+
+        UserId addUser(std::string_view username)
+        {
+            UserId existing = users.find(username);
+            if (existing != UserTable::NoUser) {
+                return existing;
+            }
+            UserId id = users.intern(username);
+            if (id == passwords.size()) {
+                passwords.emplace_back();
+                carts.emplace_back();
+                orders.emplace_back();
+                paid.push_back(0);
+                wishlists.emplace_back();
+                sessions.push_back(0);
+                lastActive.emplace_back();
+                idleTimers.push_back(TimerWheel::NoTimer);
+            }
+            return id;
+        }
 
-    std::map<int, std::pair<std::string, double>> products;
-    std::map<std::string, std::map<int, int>> userCarts;
-    std::map<std::string, std::vector<std::map<int, int>>> orders;
-    std::map<std::string, bool> userPaymentStatus;
-    std::map<std::string, std::set<int>> userWishlists;
-    std::map<std::string, std::string> userPasswords;
-    std::mutex cartMutex;
-    std::mutex wishlistMutex;
-    std::mutex passwordMutex;
+        /**
+         * @brief Frees everything a user holds; the ID goes to the next new user.
+         */
+        void removeUser(UserId id)
+        {
+            if (!users.contains(id)) {
+                return;
+            }
+            timers.cancel(idleTimers[id]);
+            users.erase(id);
+            passwords[id] = std::string();
+            carts[id] = Cart();
+            orders[id] = std::vector<Cart>();
+            paid[id] = 0;
+            wishlists[id] = std::set<int>();
+            sessions[id] = 0;
+            lastActive[id] = TimerWheel::Clock::time_point();
+            idleTimers[id] = TimerWheel::NoTimer;
+        }
+    };
+
+    /**
+     * @brief A parsed command on its way through the dispatch table.
+     *
+     * All views point into the received message and the segments are those
+     * of the whole message, header included. user is NoUser until the
+     * request has been authenticated or start has interned the user.
+     * Commands run by a batch append their responses to batchResponse
+     * instead of sending them. opcode is set for requests that came in
+     * through the binary protocol, which are answered in kind.
+     */
+    struct Request {
+        Shard& shard;
+        UserId user;
+        std::string_view username;
+        std::string_view command;
+        std::string_view password;
+        const MessageSegments& segments;
+        std::string* batchResponse = nullptr;
+        std::uint8_t opcode = 0;
+    };
+
+    struct CommandEntry {
+        std::string_view name;
+        std::size_t segments;
+        bool authenticated;
+        bool mutating;
+        void (eCommerce::*handler)(Request& request);
+    };
+
+    /**
+     * @brief The encoded browseProducts response for one catalog version.
+     *
+     * The version is derived from the contents, so a client's cached
+     * catalog stays valid across server restarts with the same catalog.
+     * It is a positive int so it fits in a command argument; 0 means the
+     * client has no catalog.
+     */
+    struct CatalogResponse {
+        std::uint64_t version;
+        std::string message;
+        std::string binaryMessage;
+    };
+
+    ProductCatalog products;
+    ProductIndex productIndex;          // over products, rebuilt by initializeProducts()
+    SuggestTrie suggestions;            // likewise
+    std::shared_ptr<const CatalogResponse> catalogResponse;
+    MpscQueue<zmq::message_t> outbox;   // messages for the pusher, sent by senderThread
+
+    ServerConfig config;
+    WriteAheadLog wal;
+    SnapshotStore snapshots;
+    std::size_t workerCount;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<zmq::socket_t> workerSenders;
+    std::vector<zmq::socket_t> workerReceivers;
+    std::vector<std::thread> workerThreads;
+
+    /**
+     * @brief Payloads of the timers on the server thread's wheel.
+     */
+    enum ServerTimer : std::uint64_t {
+        HeartbeatTimer,
+        SnapshotTimer,
+        CatalogTimer
+    };
 
     std::thread serverThread;
-    std::thread heartbeatThread;
+    std::thread senderThread;
+    TimerWheel serverTimers;
+    TimerWheel::Clock::time_point startTime;
     std::atomic<bool> running;
 
     void serverTask();
-    void heartbeatTask();
-    void handleMessage(const std::string& msg);
-    void handleCommand(const std::string& username, const std::string& command, const std::vector<std::string>& segments);
-
-    void sendResponse(const std::string& username, const std::string& command, const std::string& message, const std::string& password);
-    void handleAddToCart(const std::string& username, const std::vector<std::string>& segments, const std::string& password);
-    void handleClearCart(const std::string& username, const std::string& password);
-    void updateCartItem(const std::string& username, const std::vector<std::string>& segments, const std::string& password);
-    void cancelOrder(const std::string& username, const std::string& password);
-    void removeItemFromCart(const std::string& username, const std::vector<std::string>& segments, const std::string& password);
-    void handleAddToWishlist(const std::string& username, const std::vector<std::string>& segments, const std::string& password);
-    void handleRemoveFromWishlist(const std::string& username, const std::vector<std::string>& segments, const std::string& password);
+    void senderTask();
+    void send(std::string_view message);
+    void drainSubscriber();
+    void dispatchMessage(zmq::message_t& msg);
+    void requestSnapshot();
+    void stopWorkers();
+    void workerTask(std::size_t index);
+    std::size_t workerFor(std::string_view msg) const;
+    std::size_t workerForUser(std::string_view username) const;
+    void logShardStats();
+    static const std::array<CommandEntry, CommandCount>& commandTable();
+    static const CommandEntry* findCommand(std::string_view command);
+    void runServerTimers();
+    void runUserTimers(Shard& shard);
+    void touchUser(Shard& shard, UserId user);
+    void expireUser(Shard& shard, UserId user);
+    void evictCart(Shard& shard, UserId user);
+    void forgetUser(Shard& shard, UserId user);
+    const CommandEntry* handleMessage(Shard& shard, std::string_view msg);
+    const CommandEntry* handleBinaryMessage(Shard& shard, std::string_view msg);
+    std::uint32_t globalUserId(const Shard& shard, UserId user) const;
+    const CommandEntry* dispatchCommand(Shard& shard, const MessageSegments& segments);
+    void runCommand(const CommandEntry& entry, Request& request);
+
+    BufferPool::Pointer beginResponse(const Request& request, BinaryProtocol::Status status = BinaryProtocol::Ok);
+    void sendResponse(const Request& request, BufferPool::Pointer response);
+    void sendResponse(const Request& request, std::string_view message);
+    void sendError(const Request& request, std::string_view message);
+    void handleStart(Request& request);
+    void handleHelp(Request& request);
+    void handleKeepalive(Request& request);
+    void handleHeartbeat(Request& request);
+    void handleBrowseProducts(Request& request);
+    void handleViewCart(Request& request);
+    void handleViewOrders(Request& request);
+    void handleAddToCart(Request& request);
+    void handleClearCart(Request& request);
+    void updateCartItem(Request& request);
+    void cancelOrder(Request& request);
+    void removeItemFromCart(Request& request);
+    void handleAddToWishlist(Request& request);
+    void handleRemoveFromWishlist(Request& request);
+    void handleSearchProducts(Request& request);
+    void handleSuggest(Request& request);
+    void handleStats(Request& request);
+    void handleBatch(Request& request);
 
     std::string getHelpMessage();
     std::string getWelcomeMessage();
     std::string getBrowseProductsMessage();
-    std::string viewCart(const std::string& username);
-    std::string viewOrders(const std::string& username);
-    std::string checkWishlist(const std::string& username);
-    void addToCart(const std::string& username, int productId, int quantity);
-    void removeFromCart(const std::string& username, int productId);
-    bool canRemoveFromCart(const std::string& username, int productId);
-    void checkout(const std::string& username, const std::string& password);
-    void stop(const std::string& username, const std::string& password);
-    void pay(const std::string& username, const std::string& password);
+    std::string getBrowseProductsPayload();
+    std::string getStatsMessage();
+    void writeStatsFile();
+    void viewCart(const Request& request, std::string& out);
+    void viewOrders(const Request& request, std::string& out);
+    std::string checkWishlist(const Request& request);
+    void appendLineItems(std::string& out, const Cart& cart);
+    void addToCart(const Request& request, int productId, int quantity);
+    void checkout(Request& request);
+    void stop(Request& request);
+    void pay(Request& request);
 
     void initializeProducts();
+    void loadDefaultProducts();
+    void publishCatalog();
+    void broadcastCatalog();
     void setupConnections();
+    void recoverState();
+    std::string encodeShard(const Shard& shard);
+    void restoreShardImage(std::string_view data, std::uint64_t lsn,
+                           std::unordered_map<std::string_view, std::uint64_t>& userLsns);
     void startThreads();
     void reconnect();
 
-    std::vector<std::string> splitMessage(const std::string& msg, char delimiter);
     void validateAddToCartInput(int productId, int quantity);
-    void setUserPassword(const std::string& username, const std::string& password);
-    bool verifyUserPassword(const std::string& username, const std::string& password);
+    void setUserPassword(Request& request);
+    bool verifyUserPassword(const Request& request);
+    bool authenticate(Request& request);
+    std::string startSession(const Request& request);
 };
 
 #endif // ECOMMERCE_H
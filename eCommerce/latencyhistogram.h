@@ -0,0 +1,124 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * @brief Log-linear histogram of latencies in nanoseconds, HDR style.
+ *
+ * Values below 16 ns get a bucket each; above that every power of two is
+ * split into 16 buckets, so a reported value is at most about 6% above the
+ * recorded one. Values from 2^40 ns (about 18 minutes) on share the last
+ * bucket.
+ *
+ * Each histogram has a single writer, the worker owning it, so record() is
+ * a relaxed load and store without a locked instruction. Other threads read
+ * the counts at any time through mergeInto().
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SubBucketBits = 4;
+    static constexpr std::size_t SubBuckets = std::size_t(1) << SubBucketBits;
+    static constexpr unsigned MaxExponent = 40;
+    static constexpr std::size_t BucketCount = (MaxExponent - SubBucketBits + 1) * SubBuckets;
+
+    /**
+     * @brief Bucket counts merged from one or more histograms.
+     */
+    struct Counts {
+        std::array<std::uint64_t, BucketCount> buckets{};
+        std::uint64_t total = 0;
+
+        /**
+         * @return The upper bound of the bucket holding the given fraction
+         *         (0..1) of all values, 0 if nothing was recorded.
+         */
+        std::uint64_t percentile(double fraction) const
+        {
+            if (total == 0) {
+                return 0;
+            }
+            std::uint64_t rank = static_cast<std::uint64_t>(fraction * static_cast<double>(total) + 0.5);
+            rank = rank == 0 ? 1 : (rank > total ? total : rank);
+            std::uint64_t seen = 0;
+            for (std::size_t bucket = 0; bucket < BucketCount; ++bucket) {
+                seen += buckets[bucket];
+                if (seen >= rank) {
+                    return upperBound(bucket);
+                }
+            }
+            return upperBound(BucketCount - 1);
+        }
+
+        std::uint64_t max() const
+        {
+            for (std::size_t bucket = BucketCount; bucket > 0; --bucket) {
+                if (buckets[bucket - 1] != 0) {
+                    return upperBound(bucket - 1);
+                }
+            }
+            return 0;
+        }
+    };
+
+    void record(std::uint64_t nanos)
+    {
+        std::atomic<std::uint64_t>& count = buckets[bucketFor(nanos)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void mergeInto(Counts& counts) const
+    {
+        for (std::size_t bucket = 0; bucket < BucketCount; ++bucket) {
+            std::uint64_t count = buckets[bucket].load(std::memory_order_relaxed);
+            counts.buckets[bucket] += count;
+            counts.total += count;
+        }
+    }
+
+    static std::size_t bucketFor(std::uint64_t nanos)
+    {
+        if (nanos < SubBuckets) {
+            return static_cast<std::size_t>(nanos);
+        }
+        unsigned exponent = highestBit(nanos);
+        if (exponent >= MaxExponent) {
+            return BucketCount - 1;
+        }
+        std::size_t sub = static_cast<std::size_t>(nanos >> (exponent - SubBucketBits)) & (SubBuckets - 1);
+        return (exponent - SubBucketBits + 1) * SubBuckets + sub;
+    }
+
+    static std::uint64_t upperBound(std::size_t bucket)
+    {
+        if (bucket < SubBuckets) {
+            return bucket;
+        }
+        unsigned exponent = static_cast<unsigned>(bucket / SubBuckets) + SubBucketBits - 1;
+        std::uint64_t sub = bucket % SubBuckets;
+        std::uint64_t width = std::uint64_t(1) << (exponent - SubBucketBits);
+        return ((SubBuckets + sub) << (exponent - SubBucketBits)) + width - 1;
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, BucketCount> buckets{};
+
+    static unsigned highestBit(std::uint64_t value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<unsigned>(index);
+#else
+        return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+    }
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -1,6 +1,7 @@
 // File: main.cpp
 
 #include <QCoreApplication>
+#include <QCommandLineParser>
 #include "ecommerce.h"
 #include "loggingcategories.h"
 
@@ -15,7 +16,141 @@ int main(int argc, char *argv[])
                                      "ecommerce.critical=true\n"
                                      "heartbeat.info=false");
 
-    eCommerce *ecommerce = new eCommerce(&a);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("eCommerce server");
+    parser.addHelpOption();
+    QCommandLineOption workersOption("workers",
+                                     "Number of worker threads handling commands.",
+                                     "count",
+                                     QString::number(eCommerce::defaultWorkerCount()));
+    QCommandLineOption catalogOption("catalog",
+                                     "Binary product catalog to map (see CatalogTool).",
+                                     "file");
+    QCommandLineOption catalogIntervalOption("catalog-interval",
+                                             "Seconds between broadcasts of the catalog to all clients.",
+                                             "seconds",
+                                             "60");
+    QCommandLineOption walOption("wal",
+                                 "Write-ahead log used to recover carts, orders and accounts after a restart.",
+                                 "file");
+    QCommandLineOption walSyncOption("wal-sync",
+                                     "When the write-ahead log is synced to disk: batch, periodic or none.",
+                                     "policy",
+                                     "batch");
+    QCommandLineOption walSyncIntervalOption("wal-sync-interval",
+                                             "Sync interval in milliseconds for the periodic policy.",
+                                             "ms",
+                                             "1000");
+    QCommandLineOption snapshotOption("snapshot",
+                                      "Snapshot file written next to the write-ahead log (default: <wal>.snapshot).",
+                                      "file");
+    QCommandLineOption snapshotIntervalOption("snapshot-interval",
+                                              "Seconds between snapshots.",
+                                              "seconds",
+                                              "300");
+    QCommandLineOption sessionTimeoutOption("session-timeout",
+                                            "Minutes of inactivity after which a session token expires.",
+                                            "minutes",
+                                            "30");
+    QCommandLineOption cartTimeoutOption("cart-timeout",
+                                         "Minutes of inactivity after which a cart is evicted as abandoned.",
+                                         "minutes",
+                                         "1440");
+    QCommandLineOption accountTimeoutOption("account-timeout",
+                                            "Minutes of inactivity after which an account without cart, orders or wishlist is forgotten.",
+                                            "minutes",
+                                            "43200");
+    QCommandLineOption statsOption("stats-file",
+                                   "File the per-command statistics are written to every minute.",
+                                   "file");
+    QCommandLineOption pushOption("push",
+                                  "Broker endpoint responses are pushed to.",
+                                  "endpoint",
+                                  "tcp://benternet.pxl-ea-ict.be:24041");
+    QCommandLineOption subOption("sub",
+                                 "Broker endpoint commands are subscribed from.",
+                                 "endpoint",
+                                 "tcp://benternet.pxl-ea-ict.be:24042");
+    QCommandLineOption embeddedBrokerOption("embedded-broker",
+                                            "Run a broker inside the server, bound to the push and sub endpoints.");
+    parser.addOption(workersOption);
+    parser.addOption(catalogOption);
+    parser.addOption(catalogIntervalOption);
+    parser.addOption(walOption);
+    parser.addOption(walSyncOption);
+    parser.addOption(walSyncIntervalOption);
+    parser.addOption(snapshotOption);
+    parser.addOption(snapshotIntervalOption);
+    parser.addOption(sessionTimeoutOption);
+    parser.addOption(cartTimeoutOption);
+    parser.addOption(accountTimeoutOption);
+    parser.addOption(statsOption);
+    parser.addOption(pushOption);
+    parser.addOption(subOption);
+    parser.addOption(embeddedBrokerOption);
+    parser.process(a);
+
+    ServerConfig config;
+    bool ok = false;
+    config.workerCount = parser.value(workersOption).toUInt(&ok);
+    if (!ok || config.workerCount == 0) {
+        qCWarning(ecommercelog) << "Invalid worker count, using the default.";
+        config.workerCount = eCommerce::defaultWorkerCount();
+    }
+    config.catalogPath = parser.value(catalogOption).toStdString();
+    unsigned int catalogInterval = parser.value(catalogIntervalOption).toUInt(&ok);
+    if (ok && catalogInterval > 0) {
+        config.catalogInterval = std::chrono::seconds(catalogInterval);
+    }
+    config.walPath = parser.value(walOption).toStdString();
+    try
+    {
+        config.walSyncPolicy = WriteAheadLog::parseSyncPolicy(parser.value(walSyncOption).toStdString());
+    }
+    catch (const std::exception& e)
+    {
+        qCWarning(ecommercelog) << e.what() << "Using batch.";
+    }
+    unsigned int syncInterval = parser.value(walSyncIntervalOption).toUInt(&ok);
+    if (ok && syncInterval > 0) {
+        config.walSyncInterval = std::chrono::milliseconds(syncInterval);
+    }
+
+    config.snapshotPath = parser.value(snapshotOption).toStdString();
+    if (config.snapshotPath.empty() && !config.walPath.empty()) {
+        config.snapshotPath = config.walPath + ".snapshot";
+    }
+    unsigned int snapshotInterval = parser.value(snapshotIntervalOption).toUInt(&ok);
+    if (ok && snapshotInterval > 0) {
+        config.snapshotInterval = std::chrono::seconds(snapshotInterval);
+    }
+    unsigned int sessionTimeout = parser.value(sessionTimeoutOption).toUInt(&ok);
+    if (ok && sessionTimeout > 0) {
+        config.sessionTimeout = std::chrono::minutes(sessionTimeout);
+    }
+    unsigned int cartTimeout = parser.value(cartTimeoutOption).toUInt(&ok);
+    if (ok && cartTimeout > 0) {
+        config.cartTimeout = std::chrono::minutes(cartTimeout);
+    }
+    unsigned int accountTimeout = parser.value(accountTimeoutOption).toUInt(&ok);
+    if (ok && accountTimeout > 0) {
+        config.accountTimeout = std::chrono::minutes(accountTimeout);
+    }
+    config.statsPath = parser.value(statsOption).toStdString();
+    config.pushEndpoint = parser.value(pushOption).toStdString();
+    config.subscribeEndpoint = parser.value(subOption).toStdString();
+    config.embeddedBroker = parser.isSet(embeddedBrokerOption);
+
+    eCommerce *ecommerce = nullptr;
+    try
+    {
+        ecommerce = new eCommerce(&a, config);
+    }
+    catch (const std::exception& e)
+    {
+        qCCritical(ecommercelog) << "Start-up failed:" << e.what();
+        return 1;
+    }
 
     return a.exec();
 }
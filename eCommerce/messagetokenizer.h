@@ -0,0 +1,80 @@
+#ifndef MESSAGETOKENIZER_H
+#define MESSAGETOKENIZER_H
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Segments of a '>' delimited message, viewed in place.
+ *
+ * The segments point into the buffer that was tokenized, so they are only
+ * valid while that buffer (usually the received zmq::message_t) is alive.
+ * Splitting follows std::getline semantics: empty segments in the middle
+ * are kept and a single trailing delimiter does not add an empty segment.
+ */
+class MessageSegments {
+public:
+    static constexpr std::size_t MaxSegments = 16;
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    std::string_view operator[](std::size_t index) const { return segments[index]; }
+
+    const std::string_view* begin() const { return segments.data(); }
+    const std::string_view* end() const { return segments.data() + count; }
+
+    void push_back(std::string_view segment) { segments[count++] = segment; }
+    bool full() const { return count == MaxSegments; }
+
+private:
+    std::array<std::string_view, MaxSegments> segments{};
+    std::size_t count = 0;
+};
+
+/**
+ * @brief Splits a message on the delimiter without allocating.
+ *
+ * Messages with more than MaxSegments segments keep the remainder, delimiters
+ * included, in the last segment.
+ */
+inline MessageSegments tokenizeMessage(std::string_view msg, char delimiter = '>')
+{
+    MessageSegments segments;
+    std::size_t start = 0;
+    while (start < msg.size())
+    {
+        if (segments.size() + 1 == MessageSegments::MaxSegments) {
+            segments.push_back(msg.substr(start));
+            break;
+        }
+        std::size_t end = msg.find(delimiter, start);
+        if (end == std::string_view::npos) {
+            segments.push_back(msg.substr(start));
+            break;
+        }
+        segments.push_back(msg.substr(start, end - start));
+        start = end + 1;
+    }
+    return segments;
+}
+
+/**
+ * @brief Parses a whole segment as a decimal integer.
+ *
+ * @throws std::invalid_argument if the segment is not a number.
+ */
+inline int segmentToInt(std::string_view segment)
+{
+    int value = 0;
+    auto result = std::from_chars(segment.data(), segment.data() + segment.size(), value);
+    if (result.ec != std::errc() || result.ptr != segment.data() + segment.size()) {
+        throw std::invalid_argument("'" + std::string(segment) + "' is not a valid number.");
+    }
+    return value;
+}
+
+#endif // MESSAGETOKENIZER_H
@@ -0,0 +1,106 @@
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Helpers for amounts of money held as integer cents.
+ *
+ * Prices and totals are kept in cents so sums never drift and formatting is
+ * plain integer arithmetic.
+ */
+namespace Money {
+
+/**
+ * @brief Sums quantity * price over two parallel arrays.
+ *
+ * Written as a single branch-free loop over contiguous arrays so the
+ * compiler can vectorize it.
+ */
+inline std::int64_t totalCents(const std::int32_t* quantities, const std::int64_t* prices, std::size_t count)
+{
+    std::int64_t total = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        total += static_cast<std::int64_t>(quantities[i]) * prices[i];
+    }
+    return total;
+}
+
+/**
+ * @brief Appends an amount as "<units>.<cents>", e.g. 4999 as "49.99".
+ */
+inline void appendCents(std::string& out, std::int64_t cents)
+{
+    std::uint64_t magnitude = cents < 0 ? 0 - static_cast<std::uint64_t>(cents) : static_cast<std::uint64_t>(cents);
+    if (cents < 0) {
+        out += '-';
+    }
+
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* begin = end;
+    std::uint64_t units = magnitude / 100;
+    unsigned int fraction = static_cast<unsigned int>(magnitude % 100);
+    *--begin = static_cast<char>('0' + fraction % 10);
+    *--begin = static_cast<char>('0' + fraction / 10);
+    *--begin = '.';
+    do {
+        *--begin = static_cast<char>('0' + units % 10);
+        units /= 10;
+    } while (units != 0);
+    out.append(begin, end);
+}
+
+inline std::string formatCents(std::int64_t cents)
+{
+    std::string out;
+    appendCents(out, cents);
+    return out;
+}
+
+/**
+ * @brief Parses a decimal amount such as "49.99" or "1999" into cents.
+ *
+ * At most two decimals are accepted, so no rounding is involved.
+ *
+ * @throws std::invalid_argument if the text is not such an amount.
+ */
+inline std::int64_t parseCents(std::string_view text)
+{
+    std::size_t pos = 0;
+    bool negative = !text.empty() && text[0] == '-';
+    if (negative) {
+        ++pos;
+    }
+
+    std::int64_t units = 0;
+    std::size_t unitDigits = 0;
+    for (; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++pos, ++unitDigits) {
+        units = units * 10 + (text[pos] - '0');
+    }
+
+    std::int64_t fraction = 0;
+    std::size_t fractionDigits = 0;
+    if (pos < text.size() && text[pos] == '.') {
+        for (++pos; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++pos, ++fractionDigits) {
+            fraction = fraction * 10 + (text[pos] - '0');
+        }
+    }
+
+    if (pos != text.size() || (unitDigits == 0 && fractionDigits == 0) || unitDigits > 15 || fractionDigits > 2) {
+        throw std::invalid_argument("'" + std::string(text) + "' is not a valid amount.");
+    }
+    if (fractionDigits == 1) {
+        fraction *= 10;
+    }
+    std::int64_t cents = units * 100 + fraction;
+    return negative ? -cents : cents;
+}
+
+} // namespace Money
+
+#endif // MONEY_H
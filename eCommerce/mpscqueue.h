@@ -0,0 +1,109 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+/**
+ * @brief Unbounded lock-free queue with many producers and one consumer.
+ *
+ * A linked list with a stub node: push() is a single atomic exchange, so
+ * producers never wait for each other or for the consumer. Only the
+ * consumer may call tryPop() and wait(). The mutex is touched only when
+ * the consumer is about to sleep or has to be woken from sleeping.
+ */
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head(&stub), tail(&stub) {}
+    ~MpscQueue()
+    {
+        T value;
+        while (tryPop(value)) {
+        }
+        if (tail != &stub) {
+            delete tail;
+        }
+    }
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value)
+    {
+        Node* node = new Node(std::move(value));
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node);
+        wakeConsumer();
+    }
+
+    /**
+     * @brief Moves the oldest element into value; false if there is none.
+     *
+     * May report an empty queue while a push() is halfway done, in which
+     * case that push() wakes the consumer once it has completed.
+     */
+    bool tryPop(T& value)
+    {
+        Node* next = tail->next.load();
+        if (next == nullptr) {
+            return false;
+        }
+        value = std::move(next->value);
+        if (tail != &stub) {
+            delete tail;
+        }
+        tail = next;
+        return true;
+    }
+
+    /**
+     * @brief Blocks the consumer until an element is queued or close() is called.
+     */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping.store(true);
+        wakeup.wait(lock, [this] { return tail->next.load() != nullptr || closed.load(); });
+        sleeping.store(false);
+    }
+
+    /**
+     * @brief Wakes the consumer for good; elements can still be pushed and popped.
+     */
+    void close()
+    {
+        closed.store(true);
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wakeup.notify_one();
+    }
+
+    bool isClosed() const { return closed.load(); }
+
+private:
+    struct Node {
+        Node() = default;
+        explicit Node(T value) : value(std::move(value)) {}
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    void wakeConsumer()
+    {
+        if (sleeping.load()) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wakeup.notify_one();
+        }
+    }
+
+    Node stub;
+    std::atomic<Node*> head;    // last pushed node, shared by the producers
+    Node* tail;                 // last popped node, owned by the consumer
+    std::atomic<bool> sleeping{false};
+    std::atomic<bool> closed{false};
+    std::mutex sleepMutex;
+    std::condition_variable wakeup;
+};
+
+#endif // MPSCQUEUE_H
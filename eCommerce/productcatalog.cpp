@@ -0,0 +1,177 @@
+#include "productcatalog.h"
+#include "catalogformat.h"
+#include <QFile>
+#include <QSaveFile>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+ProductCatalog::ProductCatalog()
+{
+    clear();
+}
+
+ProductCatalog::~ProductCatalog() = default;
+
+void ProductCatalog::clear()
+{
+    mappedFile.reset();
+    prices.clear();
+    present.clear();
+    nameOffsets.assign(1, 0);
+    names.clear();
+    productCount = 0;
+    attachOwnedStorage();
+}
+
+void ProductCatalog::reserve(std::size_t productCount, std::size_t nameBytes)
+{
+    prices.reserve(productCount + 1);
+    present.reserve(productCount + 1);
+    nameOffsets.reserve(productCount + 2);
+    names.reserve(nameBytes);
+}
+
+/**
+ * @brief Appends a product to the catalog.
+ *
+ * IDs must be added in increasing order. Gaps are allowed and simply stay
+ * absent.
+ *
+ * @throws std::invalid_argument if the ID is not positive or not increasing.
+ * @throws std::logic_error if the catalog is a mapped file.
+ */
+void ProductCatalog::add(int id, std::string_view name, std::int64_t priceCents)
+{
+    if (isMapped()) {
+        throw std::logic_error("A memory-mapped catalog is read-only.");
+    }
+    if (id <= 0 || static_cast<std::size_t>(id) < present.size()) {
+        throw std::invalid_argument("Product IDs must be positive and added in increasing order.");
+    }
+    if (names.size() + name.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::invalid_argument("Product names exceed the catalog's name arena.");
+    }
+
+    // Slot 0 is never a valid product; fill any gap up to the new ID
+    std::size_t slots = static_cast<std::size_t>(id) + 1;
+    prices.resize(slots, 0);
+    present.resize(slots, 0);
+    nameOffsets.resize(slots + 1, static_cast<std::uint32_t>(names.size()));
+
+    names.append(name.data(), name.size());
+    prices[id] = priceCents;
+    present[id] = 1;
+    nameOffsets[id + 1] = static_cast<std::uint32_t>(names.size());
+    ++productCount;
+    attachOwnedStorage();
+}
+
+/**
+ * @brief Maps a binary catalog file and serves lookups straight from it.
+ *
+ * Only the header is checked; the arrays are used in place, so loading
+ * time does not depend on the number of products. name() checks each name
+ * offset it reads, so a corrupt offset yields an empty name, never a read
+ * outside the file.
+ *
+ * @throws std::runtime_error if the file cannot be mapped or is not a
+ *         catalog of the supported version.
+ */
+void ProductCatalog::load(const std::string& path)
+{
+    auto file = std::make_unique<QFile>(QString::fromStdString(path));
+    if (!file->open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("Cannot open catalog file " + path + ": " + file->errorString().toStdString());
+    }
+
+    qint64 fileSize = file->size();
+    if (fileSize < static_cast<qint64>(sizeof(CatalogFormat::CatalogFileHeader))) {
+        throw std::runtime_error("Catalog file " + path + " is too small.");
+    }
+    const uchar* data = file->map(0, fileSize);
+    if (!data) {
+        throw std::runtime_error("Cannot map catalog file " + path + ": " + file->errorString().toStdString());
+    }
+
+    CatalogFormat::CatalogFileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, CatalogFormat::Magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is not a catalog file.");
+    }
+    if (header.version != CatalogFormat::Version) {
+        throw std::runtime_error("Catalog file " + path + " has unsupported version " + std::to_string(header.version) + ".");
+    }
+    if (header.slotCount == 0 || header.slotCount > static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("Catalog file " + path + " has an invalid slot count.");
+    }
+    if (!CatalogFormat::fits(header.slotCount, header.nameBytes, static_cast<std::uint64_t>(fileSize))) {
+        throw std::runtime_error("Catalog file " + path + " is truncated or has an invalid header.");
+    }
+    CatalogFormat::Layout layout = CatalogFormat::layout(header.slotCount, header.nameBytes);
+
+    if (header.productCount >= header.slotCount) {
+        throw std::runtime_error("Catalog file " + path + " has an invalid product count.");
+    }
+
+    prices.clear();
+    present.clear();
+    nameOffsets.clear();
+    names.clear();
+    prices.shrink_to_fit();
+    present.shrink_to_fit();
+    nameOffsets.shrink_to_fit();
+    names.shrink_to_fit();
+
+    priceData = reinterpret_cast<const std::int64_t*>(data + layout.prices);
+    presentData = reinterpret_cast<const std::uint8_t*>(data + layout.present);
+    nameOffsetData = reinterpret_cast<const std::uint32_t*>(data + layout.nameOffsets);
+    nameData = reinterpret_cast<const char*>(data + layout.names);
+    slotCount = header.slotCount;
+    nameBytes = header.nameBytes;
+    productCount = header.productCount;
+    mappedFile = std::move(file);
+}
+
+/**
+ * @brief Writes the catalog in the binary format read by load().
+ *
+ * The file is replaced atomically, so servers that still map an older
+ * version of it keep reading consistent data.
+ *
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void ProductCatalog::save(const std::string& path) const
+{
+    CatalogFormat::CatalogFileHeader header{};
+    std::memcpy(header.magic, CatalogFormat::Magic, sizeof(header.magic));
+    header.version = CatalogFormat::Version;
+    header.slotCount = slotCount;
+    header.productCount = productCount;
+    header.nameBytes = nameBytes;
+    CatalogFormat::Layout layout = CatalogFormat::layout(slotCount, nameBytes);
+
+    std::vector<char> image(layout.fileSize, 0);
+    std::memcpy(image.data(), &header, sizeof(header));
+    std::memcpy(image.data() + layout.prices, priceData, slotCount * sizeof(std::int64_t));
+    std::memcpy(image.data() + layout.present, presentData, slotCount * sizeof(std::uint8_t));
+    std::memcpy(image.data() + layout.nameOffsets, nameOffsetData, (slotCount + 1) * sizeof(std::uint32_t));
+    std::memcpy(image.data() + layout.names, nameData, nameBytes);
+
+    QSaveFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(image.data(), static_cast<qint64>(image.size())) != static_cast<qint64>(image.size())
+        || !file.commit()) {
+        throw std::runtime_error("Cannot write catalog file " + path + ": " + file.errorString().toStdString());
+    }
+}
+
+void ProductCatalog::attachOwnedStorage()
+{
+    priceData = prices.data();
+    presentData = present.data();
+    nameOffsetData = nameOffsets.data();
+    nameData = names.data();
+    slotCount = present.size();
+    nameBytes = names.size();
+}
@@ -0,0 +1,107 @@
+#ifndef PRODUCTCATALOG_H
+#define PRODUCTCATALOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class QFile;
+
+/**
+ * @brief Read-mostly product catalog stored as dense, ID-indexed arrays.
+ *
+ * Product IDs index straight into structure-of-arrays storage: prices, in
+ * integer cents, are contiguous, names live in a single string arena
+ * addressed by offsets and a presence byte marks which IDs exist. Lookups
+ * are constant time and never allocate.
+ *
+ * The arrays either belong to the catalog (built with add()) or point into
+ * a memory-mapped catalog file (see load() and CatalogFormat), in which case
+ * nothing is parsed or copied and processes mapping the same file share its
+ * pages. Once built or loaded the catalog is safe to read from any number of
+ * threads.
+ */
+class ProductCatalog {
+public:
+    ProductCatalog();
+    ~ProductCatalog();
+    ProductCatalog(const ProductCatalog&) = delete;
+    ProductCatalog& operator=(const ProductCatalog&) = delete;
+
+    void clear();
+    void reserve(std::size_t productCount, std::size_t nameBytes);
+    void add(int id, std::string_view name, std::int64_t priceCents);
+
+    void load(const std::string& path);
+    void save(const std::string& path) const;
+
+    bool contains(int id) const
+    {
+        return id > 0 && static_cast<std::size_t>(id) < slotCount && presentData[id];
+    }
+
+    /**
+     * @brief Name of a product; empty for unknown IDs.
+     */
+    std::string_view name(int id) const
+    {
+        if (!contains(id)) {
+            return {};
+        }
+        std::uint32_t begin = nameOffsetData[id];
+        std::uint32_t end = nameOffsetData[id + 1];
+        if (end < begin || end > nameBytes) {
+            return {};
+        }
+        return std::string_view(nameData + begin, end - begin);
+    }
+
+    /**
+     * @brief Price of a product in cents; zero for unknown IDs.
+     */
+    std::int64_t priceCents(int id) const
+    {
+        return contains(id) ? priceData[id] : 0;
+    }
+
+    std::size_t size() const { return productCount; }
+    bool empty() const { return productCount == 0; }
+    bool isMapped() const { return mappedFile != nullptr; }
+
+    /**
+     * @brief Calls function(id, name, priceCents) for every product in ID order.
+     */
+    template <typename Function>
+    void forEach(Function function) const
+    {
+        for (std::size_t id = 1; id < slotCount; ++id) {
+            if (presentData[id]) {
+                function(static_cast<int>(id), name(static_cast<int>(id)), priceData[id]);
+            }
+        }
+    }
+
+private:
+    std::vector<std::int64_t> prices;
+    std::vector<std::uint8_t> present;
+    std::vector<std::uint32_t> nameOffsets;
+    std::string names;
+    std::unique_ptr<QFile> mappedFile;
+
+    // Views used by the lookups; they point either at the vectors above or
+    // into mappedFile.
+    const std::int64_t* priceData = nullptr;
+    const std::uint8_t* presentData = nullptr;
+    const std::uint32_t* nameOffsetData = nullptr;
+    const char* nameData = nullptr;
+    std::size_t slotCount = 0;
+    std::size_t nameBytes = 0;
+    std::size_t productCount = 0;
+
+    void attachOwnedStorage();
+};
+
+#endif // PRODUCTCATALOG_H
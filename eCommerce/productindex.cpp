@@ -0,0 +1,289 @@
+#include "productindex.h"
+#include "productcatalog.h"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+constexpr int WordScore = 2;        // term is a whole word of the name
+constexpr int SubstringScore = 1;   // term only occurs inside a word
+
+bool containsWord(const std::uint32_t* begin, const std::uint32_t* end, std::uint32_t id)
+{
+    return std::binary_search(begin, end, id);
+}
+
+/**
+ * @brief Keeps the IDs of the sorted ids that are also in the sorted range.
+ */
+void intersect(std::vector<std::uint32_t>& ids, const std::uint32_t* begin, const std::uint32_t* end)
+{
+    auto out = ids.begin();
+    for (std::uint32_t id : ids) {
+        begin = std::lower_bound(begin, end, id);
+        if (begin != end && *begin == id) {
+            *out++ = id;
+        }
+    }
+    ids.erase(out, ids.end());
+}
+
+/**
+ * @brief Case-insensitive substring test; needle is already lowercase.
+ */
+bool containsLowercase(std::string_view haystack, std::string_view needle)
+{
+    if (needle.size() > haystack.size()) {
+        return false;
+    }
+    for (std::size_t start = 0; start + needle.size() <= haystack.size(); ++start)
+    {
+        std::size_t i = 0;
+        while (i < needle.size()
+               && std::tolower(static_cast<unsigned char>(haystack[start + i])) == static_cast<unsigned char>(needle[i])) {
+            ++i;
+        }
+        if (i == needle.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+void ProductIndex::clear()
+{
+    words.clear();
+    trigrams.clear();
+    wordPostings = Postings();
+    trigramPostings = Postings();
+}
+
+/**
+ * @brief Splits text into lowercase words of ASCII letters and digits.
+ */
+std::vector<std::string> ProductIndex::tokenize(std::string_view text)
+{
+    std::vector<std::string> tokens;
+    std::string token;
+    for (char c : text)
+    {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (std::isalnum(byte)) {
+            token += static_cast<char>(std::tolower(byte));
+        } else if (!token.empty()) {
+            tokens.push_back(std::move(token));
+            token.clear();
+        }
+    }
+    if (!token.empty()) {
+        tokens.push_back(std::move(token));
+    }
+    return tokens;
+}
+
+std::uint32_t ProductIndex::trigramKey(std::string_view word, std::size_t position)
+{
+    return static_cast<std::uint32_t>(static_cast<unsigned char>(word[position])) << 16
+           | static_cast<std::uint32_t>(static_cast<unsigned char>(word[position + 1])) << 8
+           | static_cast<std::uint32_t>(static_cast<unsigned char>(word[position + 2]));
+}
+
+/**
+ * @brief Queues the words and trigrams of one product; visible after finish().
+ */
+void ProductIndex::add(int productId, std::string_view name)
+{
+    std::uint32_t id = static_cast<std::uint32_t>(productId);
+    std::vector<std::string> tokens = tokenize(name);
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+    std::vector<std::uint32_t> keys;
+    for (const std::string& token : tokens)
+    {
+        auto word = words.emplace(token, static_cast<std::uint32_t>(words.size())).first;
+        wordPostings.pending.emplace_back(word->second, id);
+        for (std::size_t i = 0; i + 3 <= token.size(); ++i) {
+            keys.push_back(trigramKey(token, i));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    for (std::uint32_t key : keys) {
+        auto trigram = trigrams.emplace(key, static_cast<std::uint32_t>(trigrams.size())).first;
+        trigramPostings.pending.emplace_back(trigram->second, id);
+    }
+}
+
+/**
+ * @brief Merges the queued postings into the sorted posting lists.
+ */
+void ProductIndex::finish()
+{
+    wordPostings.layOut(words.size());
+    trigramPostings.layOut(trigrams.size());
+}
+
+void ProductIndex::build(const ProductCatalog& catalog)
+{
+    clear();
+    catalog.forEach([this](int id, std::string_view name, std::int64_t) {
+        add(id, name);
+    });
+    finish();
+}
+
+/**
+ * @brief Counting sort of the pending pairs into rows, merged with the existing rows.
+ */
+void ProductIndex::Postings::layOut(std::size_t rows)
+{
+    for (std::uint32_t row = 0; row + 1 < offsets.size(); ++row) {
+        for (std::uint32_t i = offsets[row]; i < offsets[row + 1]; ++i) {
+            pending.emplace_back(row, ids[i]);
+        }
+    }
+
+    std::vector<std::uint32_t> counts(rows + 1, 0);
+    for (const auto& posting : pending) {
+        ++counts[posting.first + 1];
+    }
+    for (std::size_t row = 0; row < rows; ++row) {
+        counts[row + 1] += counts[row];
+    }
+    offsets = counts;
+    ids.assign(pending.size(), 0);
+    for (const auto& posting : pending) {
+        ids[counts[posting.first]++] = posting.second;
+    }
+    pending.clear();
+    pending.shrink_to_fit();
+
+    // Products added in ID order, as by build(), already come out sorted
+    for (std::size_t row = 0; row < rows; ++row) {
+        auto begin = ids.begin() + offsets[row];
+        auto end = ids.begin() + offsets[row + 1];
+        if (!std::is_sorted(begin, end)) {
+            std::sort(begin, end);
+        }
+    }
+}
+
+/**
+ * @brief The sorted IDs of products having the term as a word or inside one.
+ *
+ * Substring candidates come from intersecting the term's trigram lists,
+ * shortest first, and are then checked against the name, since trigrams
+ * spread over several words do not prove the term occurs. Candidates
+ * outside within, when given, are dropped before that check.
+ */
+std::vector<std::uint32_t> ProductIndex::matchTerm(const std::string& term, const ProductCatalog& catalog,
+                                                   const std::vector<std::uint32_t>* within) const
+{
+    std::vector<std::uint32_t> result;
+    if (term.size() < 3) {
+        auto word = words.find(term);
+        if (word != words.end()) {
+            auto row = wordPostings.row(word->second);
+            result.assign(row.first, row.second);
+        }
+        if (within) {
+            intersect(result, within->data(), within->data() + within->size());
+        }
+        return result;
+    }
+
+    std::vector<std::pair<const std::uint32_t*, const std::uint32_t*>> lists;
+    for (std::size_t i = 0; i + 3 <= term.size(); ++i)
+    {
+        auto trigram = trigrams.find(trigramKey(term, i));
+        if (trigram == trigrams.end()) {
+            return result;
+        }
+        lists.push_back(trigramPostings.row(trigram->second));
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) {
+        return a.second - a.first < b.second - b.first;
+    });
+
+    if (within) {
+        result = *within;
+        intersect(result, lists[0].first, lists[0].second);
+    } else {
+        result.assign(lists[0].first, lists[0].second);
+    }
+    for (std::size_t list = 1; list < lists.size() && !result.empty(); ++list) {
+        intersect(result, lists[list].first, lists[list].second);
+    }
+
+    if (lists.size() > 1) {
+        result.erase(std::remove_if(result.begin(), result.end(), [&](std::uint32_t id) {
+            return !containsLowercase(catalog.name(static_cast<int>(id)), term);
+        }), result.end());
+    }
+    return result;
+}
+
+/**
+ * @brief Finds the products matching every word of the query.
+ *
+ * A term scores more when it is a whole word of the name than when it only
+ * occurs inside one. The best matches come first, shorter names first
+ * among equal scores, and at most limit are returned.
+ */
+std::vector<ProductIndex::Match> ProductIndex::search(std::string_view query, std::size_t limit, const ProductCatalog& catalog) const
+{
+    std::vector<Match> matches;
+    std::vector<std::string> terms = tokenize(query);
+    if (terms.empty() || limit == 0) {
+        return matches;
+    }
+
+    // Longer terms are usually rarer, so they narrow the candidates first
+    std::vector<std::string> order = terms;
+    std::stable_sort(order.begin(), order.end(), [](const std::string& a, const std::string& b) {
+        return a.size() > b.size();
+    });
+    std::vector<std::uint32_t> candidates;
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        candidates = matchTerm(order[i], catalog, i == 0 ? nullptr : &candidates);
+        if (candidates.empty()) {
+            return matches;
+        }
+    }
+
+    matches.reserve(candidates.size());
+    for (std::uint32_t id : candidates)
+    {
+        int score = 0;
+        for (const std::string& term : terms) {
+            auto word = words.find(term);
+            bool whole = false;
+            if (word != words.end()) {
+                auto row = wordPostings.row(word->second);
+                whole = containsWord(row.first, row.second, id);
+            }
+            score += whole ? WordScore : SubstringScore;
+        }
+        matches.push_back({ static_cast<int>(id), score });
+    }
+
+    auto better = [&catalog](const Match& a, const Match& b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        std::size_t aLength = catalog.name(a.productId).size();
+        std::size_t bLength = catalog.name(b.productId).size();
+        return aLength != bLength ? aLength < bLength : a.productId < b.productId;
+    };
+    if (matches.size() > limit) {
+        std::partial_sort(matches.begin(), matches.begin() + static_cast<std::ptrdiff_t>(limit), matches.end(), better);
+        matches.resize(limit);
+    } else {
+        std::sort(matches.begin(), matches.end(), better);
+    }
+    return matches;
+}
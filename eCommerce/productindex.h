@@ -0,0 +1,70 @@
+#ifndef PRODUCTINDEX_H
+#define PRODUCTINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class ProductCatalog;
+
+/**
+ * @brief Inverted index over product names for searchProducts.
+ *
+ * Names are split into lowercase alphanumeric words. Every word is indexed
+ * whole and by its trigrams, so a query term matches a product that has
+ * the term as a word or inside a word. Posting lists are sorted product IDs
+ * stored back to back in one array with an offset per key (compressed
+ * sparse rows), which keeps a multi-million product index to a few flat
+ * allocations.
+ *
+ * Products are added one at a time with add() and finish() lays out the
+ * postings; build() does both for a whole catalog. Once finished the
+ * index is safe to search from any number of threads.
+ */
+class ProductIndex {
+public:
+    struct Match {
+        int productId;
+        int score;
+    };
+
+    void clear();
+    void add(int productId, std::string_view name);
+    void finish();
+    void build(const ProductCatalog& catalog);
+
+    std::vector<Match> search(std::string_view query, std::size_t limit, const ProductCatalog& catalog) const;
+
+    std::size_t wordCount() const { return words.size(); }
+    std::size_t postingCount() const { return wordPostings.ids.size() + trigramPostings.ids.size(); }
+
+    static std::vector<std::string> tokenize(std::string_view text);
+
+private:
+    struct Postings {
+        std::vector<std::uint32_t> offsets;     // row r is ids[offsets[r], offsets[r + 1])
+        std::vector<std::uint32_t> ids;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pending;  // (row, id) pairs until finish()
+
+        void layOut(std::size_t rows);
+        std::pair<const std::uint32_t*, const std::uint32_t*> row(std::uint32_t index) const
+        {
+            return { ids.data() + offsets[index], ids.data() + offsets[index + 1] };
+        }
+    };
+
+    static std::uint32_t trigramKey(std::string_view word, std::size_t position);
+    std::vector<std::uint32_t> matchTerm(const std::string& term, const ProductCatalog& catalog,
+                                         const std::vector<std::uint32_t>* within) const;
+
+    std::unordered_map<std::string, std::uint32_t> words;        // word -> row of wordPostings
+    std::unordered_map<std::uint32_t, std::uint32_t> trigrams;   // packed trigram -> row of trigramPostings
+    Postings wordPostings;
+    Postings trigramPostings;
+};
+
+#endif // PRODUCTINDEX_H
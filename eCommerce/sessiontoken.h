@@ -0,0 +1,64 @@
+#ifndef SESSIONTOKEN_H
+#define SESSIONTOKEN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Session tokens handed out by start.
+ *
+ * A token is 24 lowercase hex digits: the user's global ID (shard-local ID
+ * times the worker count plus the shard index) followed by a random 64-bit
+ * secret. Carrying the ID lets the server route the request and find the
+ * session by indexing instead of hashing or looking the username up.
+ */
+namespace SessionToken {
+
+constexpr std::size_t Length = 24;
+
+inline std::string format(std::uint32_t user, std::uint64_t secret)
+{
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string token(Length, '0');
+    for (std::size_t i = 0; i < 8; ++i) {
+        token[7 - i] = digits[(user >> (4 * i)) & 0xF];
+    }
+    for (std::size_t i = 0; i < 16; ++i) {
+        token[Length - 1 - i] = digits[(secret >> (4 * i)) & 0xF];
+    }
+    return token;
+}
+
+/**
+ * @return false if the text does not have the shape of a token.
+ */
+inline bool parse(std::string_view token, std::uint32_t& user, std::uint64_t& secret)
+{
+    if (token.size() != Length) {
+        return false;
+    }
+    std::uint64_t values[2] = { 0, 0 };
+    for (std::size_t i = 0; i < Length; ++i)
+    {
+        char c = token[i];
+        std::uint64_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = static_cast<std::uint64_t>(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = static_cast<std::uint64_t>(c - 'a' + 10);
+        } else {
+            return false;
+        }
+        std::uint64_t& value = values[i < 8 ? 0 : 1];
+        value = (value << 4) | digit;
+    }
+    user = static_cast<std::uint32_t>(values[0]);
+    secret = values[1];
+    return true;
+}
+
+} // namespace SessionToken
+
+#endif // SESSIONTOKEN_H
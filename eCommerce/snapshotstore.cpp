@@ -0,0 +1,182 @@
+#include "snapshotstore.h"
+#include "checksum.h"
+#include "loggingcategories.h"
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+constexpr char FileMagic[4] = { 'E', 'S', 'N', 'P' };
+constexpr std::uint32_t FileVersion = 1;
+
+} // namespace
+
+SnapshotStore::~SnapshotStore()
+{
+    close();
+}
+
+/**
+ * @brief Starts the writer thread for snapshots saved to path.
+ */
+void SnapshotStore::open(const std::string& path, const WrittenFunction& written)
+{
+    close();
+    this->path = path;
+    this->written = written;
+    stopping = false;
+    writerThread = std::thread(&SnapshotStore::writerTask, this);
+}
+
+/**
+ * @brief Stops the writer thread; a snapshot still being collected is dropped.
+ */
+void SnapshotStore::close()
+{
+    if (writerThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_one();
+        writerThread.join();
+    }
+}
+
+/**
+ * @brief Starts collecting a new snapshot of shardCount shards.
+ *
+ * @return false if the previous snapshot is still being collected or written.
+ */
+bool SnapshotStore::begin(std::size_t shardCount)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (inProgress || !isOpen()) {
+        return false;
+    }
+    inProgress = true;
+    images.assign(shardCount, ShardImage());
+    outstanding = shardCount;
+    return true;
+}
+
+/**
+ * @brief Hands in the image of one shard; called by the owning worker.
+ */
+void SnapshotStore::submit(std::size_t shard, std::uint64_t lsn, std::string data)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    images[shard].lsn = lsn;
+    images[shard].data = std::move(data);
+    if (--outstanding == 0) {
+        condition.notify_one();
+    }
+}
+
+/**
+ * @brief Reads the shard images of a snapshot file.
+ *
+ * @return The images, or nothing if the file does not exist.
+ * @throws std::runtime_error if the file cannot be read or is corrupt.
+ */
+std::vector<SnapshotStore::ShardImage> SnapshotStore::load(const std::string& path)
+{
+    std::vector<ShardImage> images;
+    QFile file(QString::fromStdString(path));
+    if (!file.exists()) {
+        return images;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("Cannot open snapshot " + path + ": " + file.errorString().toStdString());
+    }
+    qint64 size = file.size();
+    const uchar* data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data) {
+        throw std::runtime_error("Cannot map snapshot " + path + ": " + file.errorString().toStdString());
+    }
+    // The mapping goes away with the file, the images are copied out of it
+    SnapshotReader reader(std::string_view(reinterpret_cast<const char*>(data), static_cast<std::size_t>(size)));
+
+    if (reader.getBytes(sizeof(FileMagic)) != std::string_view(FileMagic, sizeof(FileMagic)) || reader.get<std::uint32_t>() != FileVersion) {
+        throw std::runtime_error("The snapshot " + path + " has an unknown format.");
+    }
+
+    std::uint32_t shardCount = reader.get<std::uint32_t>();
+    images.resize(shardCount);
+    for (ShardImage& image : images)
+    {
+        image.lsn = reader.get<std::uint64_t>();
+        std::uint64_t imageSize = reader.get<std::uint64_t>();
+        std::uint32_t imageChecksum = reader.get<std::uint32_t>();
+        image.data = std::string(reader.getBytes(static_cast<std::size_t>(imageSize)));
+        if (fnv1a(image.data.data(), image.data.size()) != imageChecksum) {
+            throw std::runtime_error("The snapshot " + path + " is corrupt.");
+        }
+    }
+    return images;
+}
+
+void SnapshotStore::writerTask()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        condition.wait(lock, [this] { return stopping || (inProgress && outstanding == 0); });
+        if (stopping) {
+            break;
+        }
+
+        std::vector<ShardImage> collected;
+        collected.swap(images);
+        lock.unlock();
+
+        auto begin = std::chrono::steady_clock::now();
+        if (write(collected)) {
+            std::uint64_t coveredLsn = collected.empty() ? 0 : collected.front().lsn;
+            std::size_t bytes = 0;
+            for (const ShardImage& image : collected) {
+                coveredLsn = std::min(coveredLsn, image.lsn);
+                bytes += image.data.size();
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+            qCInfo(ecommercelog) << "Snapshot written:" << bytes << "bytes in" << elapsed.count() << "ms, covering LSN" << coveredLsn;
+            if (written) {
+                written(coveredLsn);
+            }
+        }
+
+        lock.lock();
+        inProgress = false;
+    }
+}
+
+bool SnapshotStore::write(const std::vector<ShardImage>& images)
+{
+    std::string header;
+    SnapshotWriter writer(header);
+    writer.putBytes(std::string_view(FileMagic, sizeof(FileMagic)));
+    writer.put<std::uint32_t>(FileVersion);
+    writer.put<std::uint32_t>(static_cast<std::uint32_t>(images.size()));
+
+    QSaveFile file(QString::fromStdString(path));
+    bool ok = file.open(QIODevice::WriteOnly)
+              && file.write(header.data(), static_cast<qint64>(header.size())) == static_cast<qint64>(header.size());
+    for (const ShardImage& image : images)
+    {
+        std::string imageHeader;
+        SnapshotWriter imageWriter(imageHeader);
+        imageWriter.put<std::uint64_t>(image.lsn);
+        imageWriter.put<std::uint64_t>(image.data.size());
+        imageWriter.put<std::uint32_t>(fnv1a(image.data.data(), image.data.size()));
+        ok = ok
+             && file.write(imageHeader.data(), static_cast<qint64>(imageHeader.size())) == static_cast<qint64>(imageHeader.size())
+             && file.write(image.data.data(), static_cast<qint64>(image.data.size())) == static_cast<qint64>(image.data.size());
+    }
+    if (!ok || !file.commit()) {
+        qCCritical(ecommercelog) << "Cannot write snapshot" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,141 @@
+#ifndef SNAPSHOTSTORE_H
+#define SNAPSHOTSTORE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Appends fixed-size values and length-prefixed strings to a buffer.
+ */
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::string& out) : out(out) {}
+
+    template <typename T>
+    void put(T value) { out.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+    void putBytes(std::string_view bytes) { out.append(bytes.data(), bytes.size()); }
+
+    void putString(std::string_view value)
+    {
+        put<std::uint32_t>(static_cast<std::uint32_t>(value.size()));
+        putBytes(value);
+    }
+
+private:
+    std::string& out;
+};
+
+/**
+ * @brief Reads back what a SnapshotWriter wrote.
+ *
+ * @throws std::runtime_error when reading past the end of the data.
+ */
+class SnapshotReader {
+public:
+    explicit SnapshotReader(std::string_view data) : data(data) {}
+
+    bool atEnd() const { return offset == data.size(); }
+
+    template <typename T>
+    T get()
+    {
+        require(sizeof(T));
+        T value;
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return value;
+    }
+
+    std::string_view getBytes(std::size_t size)
+    {
+        require(size);
+        std::string_view bytes = data.substr(offset, size);
+        offset += size;
+        return bytes;
+    }
+
+    std::string_view getString() { return getBytes(get<std::uint32_t>()); }
+
+private:
+    void require(std::size_t size) const
+    {
+        if (data.size() - offset < size) {
+            throw std::runtime_error("Snapshot data is truncated.");
+        }
+    }
+
+    std::string_view data;
+    std::size_t offset = 0;
+};
+
+/**
+ * @brief Collects per-shard snapshot images and writes them to one file.
+ *
+ * Each worker encodes its own shard between two commands and submits the
+ * image together with the last LSN the log had assigned at that moment.
+ * A shard's records are appended by its own worker, so every one of them
+ * up to that LSN is in the image, even if the shard has been idle. Once
+ * every shard has reported, a background thread writes the file and calls
+ * the written callback with the oldest of those LSNs, so the log up to it
+ * can be dropped.
+ *
+ * File layout, in host byte order: "ESNP", a std::uint32_t version and shard
+ * count, then per shard
+ *
+ *   std::uint64_t lsn
+ *   std::uint64_t size
+ *   std::uint32_t checksum        FNV-1a of data
+ *   char          data[size]
+ *
+ * The file is replaced atomically, so a crash while writing keeps the
+ * previous snapshot.
+ */
+class SnapshotStore {
+public:
+    struct ShardImage {
+        std::uint64_t lsn = 0;
+        std::string data;
+    };
+
+    using WrittenFunction = std::function<void(std::uint64_t coveredLsn)>;
+
+    SnapshotStore() = default;
+    ~SnapshotStore();
+    SnapshotStore(const SnapshotStore&) = delete;
+    SnapshotStore& operator=(const SnapshotStore&) = delete;
+
+    void open(const std::string& path, const WrittenFunction& written);
+    void close();
+    bool isOpen() const { return writerThread.joinable(); }
+
+    bool begin(std::size_t shardCount);
+    void submit(std::size_t shard, std::uint64_t lsn, std::string data);
+
+    static std::vector<ShardImage> load(const std::string& path);
+
+private:
+    std::string path;
+    WrittenFunction written;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<ShardImage> images;
+    std::size_t outstanding = 0;
+    bool inProgress = false;
+    bool stopping = false;
+    std::thread writerThread;
+
+    void writerTask();
+    bool write(const std::vector<ShardImage>& images);
+};
+
+#endif // SNAPSHOTSTORE_H
@@ -0,0 +1,236 @@
+#include "suggesttrie.h"
+#include "productcatalog.h"
+#include <algorithm>
+#include <cctype>
+#include <utility>
+
+/**
+ * @brief Lowercases ASCII letters and digits and turns every other run into one space.
+ *
+ * Leading separators are dropped; a trailing one is kept, so a prefix
+ * typed up to the end of a word only matches where another word follows.
+ */
+std::string SuggestTrie::normalize(std::string_view text)
+{
+    std::string result;
+    result.reserve(text.size());
+    bool separator = false;
+    for (char c : text)
+    {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (std::isalnum(byte)) {
+            if (separator && !result.empty()) {
+                result += ' ';
+            }
+            separator = false;
+            result += static_cast<char>(std::tolower(byte));
+        } else {
+            separator = true;
+        }
+    }
+    if (separator && !result.empty()) {
+        result += ' ';
+    }
+    return result;
+}
+
+std::uint32_t SuggestTrie::addNode(std::uint32_t parent, std::uint32_t labelStart, std::uint32_t labelLength)
+{
+    Node node;
+    node.labelStart = labelStart;
+    node.labelLength = labelLength;
+    node.nextSibling = nodes[parent].firstChild;
+    nodes.push_back(node);
+    nodes[parent].firstChild = static_cast<std::uint32_t>(nodes.size() - 1);
+    return nodes[parent].firstChild;
+}
+
+/**
+ * @brief Builds the trie from every name suffix that starts at a word.
+ *
+ * The suffixes are sorted and inserted in order, so only the rightmost
+ * path of the trie changes: a suffix splits at most one edge of it and
+ * adds at most one leaf. Children are prepended, which keeps the newest,
+ * rightmost child first in its sibling list.
+ */
+void SuggestTrie::build(const ProductCatalog& catalog)
+{
+    struct Key {
+        std::uint32_t start;
+        std::uint32_t length;
+        int productId;
+    };
+
+    names.clear();
+    nodes.assign(1, Node());
+    tops.clear();
+
+    std::vector<Key> keys;
+    catalog.forEach([&](int id, std::string_view name, std::int64_t) {
+        std::string normalized = normalize(name);
+        if (!normalized.empty() && normalized.back() == ' ') {
+            normalized.pop_back();
+        }
+        std::uint32_t base = static_cast<std::uint32_t>(names.size());
+        std::uint32_t length = static_cast<std::uint32_t>(normalized.size());
+        for (std::uint32_t i = 0; i < length; ++i) {
+            if (i == 0 || normalized[i - 1] == ' ') {
+                keys.push_back({ base + i, length - i, id });
+            }
+        }
+        names += normalized;
+    });
+
+    auto view = [this](const Key& key) {
+        return std::string_view(names.data() + key.start, key.length);
+    };
+    std::sort(keys.begin(), keys.end(), [&view](const Key& a, const Key& b) {
+        int order = view(a).compare(view(b));
+        return order != 0 ? order < 0 : a.productId < b.productId;
+    });
+
+    std::vector<std::pair<std::uint32_t, int>> terminals;    // (node, product) where a key ends
+    terminals.reserve(keys.size());
+    nodes.reserve(keys.size() + 1);
+    std::vector<std::uint32_t> path = { 0 };
+    std::vector<std::uint32_t> depths = { 0 };
+    std::string_view previous;
+    for (const Key& key : keys)
+    {
+        std::string_view current = view(key);
+        std::uint32_t common = 0;
+        while (common < previous.size() && common < current.size() && previous[common] == current[common]) {
+            ++common;
+        }
+
+        std::uint32_t last = NoNode;
+        while (depths.back() > common) {
+            last = path.back();
+            path.pop_back();
+            depths.pop_back();
+        }
+        if (depths.back() < common)
+        {
+            // The common prefix ends inside the edge to last: split it
+            std::uint32_t parent = path.back();
+            std::uint32_t cut = common - depths.back();
+            Node middle;
+            middle.labelStart = nodes[last].labelStart;
+            middle.labelLength = cut;
+            middle.firstChild = last;
+            middle.nextSibling = nodes[last].nextSibling;
+            nodes.push_back(middle);
+            std::uint32_t split = static_cast<std::uint32_t>(nodes.size() - 1);
+            nodes[parent].firstChild = split;
+            nodes[last].nextSibling = NoNode;
+            nodes[last].labelStart += cut;
+            nodes[last].labelLength -= cut;
+            path.push_back(split);
+            depths.push_back(common);
+        }
+        if (current.size() > common) {
+            path.push_back(addNode(path.back(), key.start + common, key.length - common));
+            depths.push_back(key.length);
+        }
+        terminals.emplace_back(path.back(), key.productId);
+        previous = current;
+    }
+
+    rankNodes(catalog, terminals);
+}
+
+/**
+ * @brief Stores the best products of every subtree, children before parents.
+ *
+ * Shorter names rank first, then lower IDs. A product reached through
+ * several of its words is listed once.
+ */
+void SuggestTrie::rankNodes(const ProductCatalog& catalog, const std::vector<std::pair<std::uint32_t, int>>& terminals)
+{
+    std::vector<std::uint32_t> firstTerminal(nodes.size() + 1, 0);
+    for (const auto& terminal : terminals) {
+        ++firstTerminal[terminal.first + 1];
+    }
+    for (std::size_t node = 0; node < nodes.size(); ++node) {
+        firstTerminal[node + 1] += firstTerminal[node];
+    }
+    std::vector<int> terminalProducts(terminals.size());
+    std::vector<std::uint32_t> fill(firstTerminal.begin(), firstTerminal.end() - 1);
+    for (const auto& terminal : terminals) {
+        terminalProducts[fill[terminal.first]++] = terminal.second;
+    }
+
+    // Sort key of a product: name length above its ID
+    auto rank = [&catalog](int id) {
+        return static_cast<std::uint64_t>(catalog.name(id).size()) << 32 | static_cast<std::uint32_t>(id);
+    };
+
+    std::vector<std::uint64_t> candidates;
+    std::vector<std::pair<std::uint32_t, bool>> stack = { { 0, false } };
+    while (!stack.empty())
+    {
+        auto [node, childrenDone] = stack.back();
+        if (!childrenDone) {
+            stack.back().second = true;
+            for (std::uint32_t child = nodes[node].firstChild; child != NoNode; child = nodes[child].nextSibling) {
+                stack.emplace_back(child, false);
+            }
+            continue;
+        }
+        stack.pop_back();
+
+        candidates.clear();
+        for (std::uint32_t i = firstTerminal[node]; i < firstTerminal[node + 1]; ++i) {
+            candidates.push_back(rank(terminalProducts[i]));
+        }
+        for (std::uint32_t child = nodes[node].firstChild; child != NoNode; child = nodes[child].nextSibling) {
+            for (std::uint32_t i = 0; i < nodes[child].topCount; ++i) {
+                candidates.push_back(rank(tops[nodes[child].topStart + i]));
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        std::size_t count = std::min(candidates.size(), MaxSuggestions);
+
+        nodes[node].topStart = static_cast<std::uint32_t>(tops.size());
+        nodes[node].topCount = static_cast<std::uint32_t>(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            tops.push_back(static_cast<int>(candidates[i] & 0xFFFFFFFF));
+        }
+    }
+}
+
+/**
+ * @brief The best products having a word that starts with prefix, followed by the rest of the name.
+ *
+ * Walks one edge per matched label, checking at most one child per
+ * possible character, and copies at most MaxSuggestions IDs.
+ */
+std::vector<int> SuggestTrie::suggest(std::string_view prefix) const
+{
+    std::string key = normalize(prefix);
+    if (key.empty() || nodes.empty()) {
+        return {};
+    }
+
+    std::uint32_t node = 0;
+    std::size_t matched = 0;
+    while (matched < key.size())
+    {
+        std::uint32_t child = nodes[node].firstChild;
+        while (child != NoNode && names[nodes[child].labelStart] != key[matched]) {
+            child = nodes[child].nextSibling;
+        }
+        if (child == NoNode) {
+            return {};
+        }
+        std::size_t length = std::min<std::size_t>(nodes[child].labelLength, key.size() - matched);
+        if (names.compare(nodes[child].labelStart, length, key, matched, length) != 0) {
+            return {};
+        }
+        matched += length;
+        node = child;
+    }
+    auto begin = tops.begin() + nodes[node].topStart;
+    return std::vector<int>(begin, begin + nodes[node].topCount);
+}
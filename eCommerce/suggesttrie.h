@@ -0,0 +1,57 @@
+#ifndef SUGGESTTRIE_H
+#define SUGGESTTRIE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ProductCatalog;
+
+/**
+ * @brief Radix trie over product names for type-ahead suggestions.
+ *
+ * Names are lowercased with every run of other characters turned into one
+ * space, and inserted once from the start of each word, so "gal" suggests
+ * "Samsung Galaxy S21". Every node keeps the best MaxSuggestions products
+ * below it, computed when the trie is built, so a lookup only walks the
+ * prefix and copies one list: its cost does not depend on the catalog size.
+ *
+ * Edge labels point into the normalised names instead of owning their
+ * text. The trie is read-only after build() and safe to query from any
+ * number of threads.
+ */
+class SuggestTrie {
+public:
+    static constexpr std::size_t MaxSuggestions = 10;
+
+    void build(const ProductCatalog& catalog);
+    std::vector<int> suggest(std::string_view prefix) const;
+
+    std::size_t nodeCount() const { return nodes.size(); }
+
+    static std::string normalize(std::string_view text);
+
+private:
+    static constexpr std::uint32_t NoNode = 0xFFFFFFFF;
+
+    struct Node {
+        std::uint32_t labelStart = 0;       // label is names[labelStart, labelStart + labelLength)
+        std::uint32_t labelLength = 0;
+        std::uint32_t firstChild = NoNode;
+        std::uint32_t nextSibling = NoNode;
+        std::uint32_t topStart = 0;         // best products are tops[topStart, topStart + topCount)
+        std::uint32_t topCount = 0;
+    };
+
+    std::uint32_t addNode(std::uint32_t parent, std::uint32_t labelStart, std::uint32_t labelLength);
+    void rankNodes(const ProductCatalog& catalog, const std::vector<std::pair<std::uint32_t, int>>& terminals);
+
+    std::string names;                      // normalised names, back to back
+    std::vector<Node> nodes;                // nodes[0] is the root
+    std::vector<std::uint32_t> lastChild;   // only used while building
+    std::vector<int> tops;
+};
+
+#endif // SUGGESTTRIE_H
@@ -0,0 +1,182 @@
+#include "timerwheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel(Clock::duration tick, Clock::time_point start)
+    : tick(tick), start(start)
+{
+    heads.fill(None);
+}
+
+/**
+ * @brief Schedules a timer that fires after delay, rounded up to whole ticks.
+ *
+ * @return An ID for cancel(); never NoTimer.
+ */
+TimerWheel::TimerId TimerWheel::schedule(Clock::duration delay, std::uint64_t payload)
+{
+    std::uint32_t index;
+    if (freeList != None) {
+        index = freeList;
+        freeList = nodes[index].next;
+    } else {
+        index = static_cast<std::uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    std::uint64_t ticks = delay <= Clock::duration::zero() ? 1 : static_cast<std::uint64_t>((delay + tick - Clock::duration(1)) / tick);
+    Node& node = nodes[index];
+    node.expiry = currentTick + std::max<std::uint64_t>(ticks, 1);
+    node.payload = payload;
+    node.active = true;
+    link(index);
+    ++activeCount;
+    return (static_cast<TimerId>(node.generation) << 32) | index;
+}
+
+/**
+ * @return false if the timer already fired or was cancelled.
+ */
+bool TimerWheel::cancel(TimerId id)
+{
+    std::uint32_t index = static_cast<std::uint32_t>(id);
+    if (id == NoTimer || index >= nodes.size()) {
+        return false;
+    }
+    Node& node = nodes[index];
+    if (!node.active || node.generation != static_cast<std::uint32_t>(id >> 32)) {
+        return false;
+    }
+    unlink(index);
+    release(index);
+    return true;
+}
+
+/**
+ * @brief Turns the wheel up to now and collects the payloads of due timers.
+ *
+ * Payloads are appended to fired in expiry order. Timers scheduled by the
+ * caller afterwards count from now.
+ */
+void TimerWheel::advance(Clock::time_point now, std::vector<std::uint64_t>& fired)
+{
+    if (now < start) {
+        return;
+    }
+    std::uint64_t target = static_cast<std::uint64_t>((now - start) / tick);
+    while (currentTick < target)
+    {
+        if (activeCount == 0) {
+            currentTick = target;
+            break;
+        }
+        ++currentTick;
+
+        // Entering a new round of a level pulls the matching slot of the
+        // level above down into the finer levels
+        for (std::uint32_t level = 1; level < Levels; ++level) {
+            if ((currentTick & ((std::uint64_t(1) << (SlotBits * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+
+        std::uint32_t slot = static_cast<std::uint32_t>(currentTick & (Slots - 1));
+        std::uint32_t index = heads[slot];
+        heads[slot] = None;
+        while (index != None)
+        {
+            std::uint32_t next = nodes[index].next;
+            if (nodes[index].expiry > currentTick) {
+                // Parked beyond the wheel's span; goes round again
+                link(index);
+            } else {
+                fired.push_back(nodes[index].payload);
+                release(index);
+            }
+            index = next;
+        }
+    }
+}
+
+/**
+ * @brief Returns how long the owner may sleep before calling advance().
+ *
+ * Exact for timers in the next 64 ticks, otherwise the time until the next
+ * cascade. Returns a negative duration when no timer is pending.
+ */
+TimerWheel::Clock::duration TimerWheel::timeUntilNext(Clock::time_point now) const
+{
+    if (activeCount == 0) {
+        return Clock::duration(-1);
+    }
+    std::uint64_t next = (currentTick | (Slots - 1)) + 1;
+    for (std::uint64_t t = currentTick + 1; t < next; ++t) {
+        if (heads[t & (Slots - 1)] != None) {
+            next = t;
+            break;
+        }
+    }
+    Clock::time_point due = start + tick * static_cast<Clock::rep>(next);
+    return due > now ? due - now : Clock::duration::zero();
+}
+
+void TimerWheel::link(std::uint32_t index)
+{
+    Node& node = nodes[index];
+    std::uint64_t delta = node.expiry - currentTick;
+    std::uint32_t level = 0;
+    while (level + 1 < Levels && delta >= (std::uint64_t(1) << (SlotBits * (level + 1)))) {
+        ++level;
+    }
+
+    std::uint64_t expiry = node.expiry;
+    if (delta >= (std::uint64_t(1) << (SlotBits * Levels))) {
+        // Beyond the wheel's span: park in the last reachable slot
+        expiry = currentTick + (std::uint64_t(1) << (SlotBits * Levels)) - 1;
+    }
+    std::uint32_t slot = level * Slots + static_cast<std::uint32_t>((expiry >> (SlotBits * level)) & (Slots - 1));
+
+    node.slot = static_cast<std::uint16_t>(slot);
+    node.prev = None;
+    node.next = heads[slot];
+    if (node.next != None) {
+        nodes[node.next].prev = index;
+    }
+    heads[slot] = index;
+}
+
+void TimerWheel::unlink(std::uint32_t index)
+{
+    Node& node = nodes[index];
+    if (node.prev != None) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[node.slot] = node.next;
+    }
+    if (node.next != None) {
+        nodes[node.next].prev = node.prev;
+    }
+}
+
+void TimerWheel::release(std::uint32_t index)
+{
+    Node& node = nodes[index];
+    node.active = false;
+    ++node.generation;
+    node.next = freeList;
+    freeList = index;
+    --activeCount;
+}
+
+void TimerWheel::cascade(std::uint32_t level)
+{
+    std::uint32_t slot = level * Slots + static_cast<std::uint32_t>((currentTick >> (SlotBits * level)) & (Slots - 1));
+    std::uint32_t index = heads[slot];
+    heads[slot] = None;
+    while (index != None)
+    {
+        std::uint32_t next = nodes[index].next;
+        link(index);
+        index = next;
+    }
+}
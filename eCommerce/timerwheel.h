@@ -0,0 +1,72 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Hierarchical timer wheel with O(1) schedule and cancel.
+ *
+ * Four levels of 64 slots cover 2^24 ticks; level 0 holds the next 64
+ * ticks and each higher level 64 times the span of the one below. Timers
+ * further out are parked in the last slot and cascade down as the wheel
+ * turns. Each timer carries a 64-bit payload that advance() hands back when
+ * it fires, so the owner decides what to do without a callback per timer.
+ *
+ * Timers live in a slab of nodes linked into per-slot lists, and freed
+ * nodes are reused. A TimerId holds a node index and a generation, so
+ * cancelling a timer that already fired is harmlessly ignored.
+ *
+ * Not thread-safe; every wheel belongs to one thread.
+ */
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimerId = std::uint64_t;
+    static constexpr TimerId NoTimer = 0;
+
+    explicit TimerWheel(Clock::duration tick = std::chrono::seconds(1), Clock::time_point start = Clock::now());
+
+    bool empty() const { return activeCount == 0; }
+    std::size_t size() const { return activeCount; }
+
+    TimerId schedule(Clock::duration delay, std::uint64_t payload);
+    bool cancel(TimerId id);
+
+    void advance(Clock::time_point now, std::vector<std::uint64_t>& fired);
+    Clock::duration timeUntilNext(Clock::time_point now) const;
+
+private:
+    static constexpr std::uint32_t Levels = 4;
+    static constexpr std::uint32_t SlotBits = 6;
+    static constexpr std::uint32_t Slots = 1u << SlotBits;
+    static constexpr std::uint32_t None = static_cast<std::uint32_t>(-1);
+
+    struct Node {
+        std::uint64_t expiry = 0;       // in ticks
+        std::uint64_t payload = 0;
+        std::uint32_t prev = None;
+        std::uint32_t next = None;
+        std::uint32_t generation = 1;
+        std::uint16_t slot = 0;         // level * Slots + slot index
+        bool active = false;
+    };
+
+    Clock::duration tick;
+    Clock::time_point start;
+    std::uint64_t currentTick = 0;
+    std::size_t activeCount = 0;
+
+    std::vector<Node> nodes;
+    std::uint32_t freeList = None;
+    std::array<std::uint32_t, Levels * Slots> heads;
+
+    void link(std::uint32_t index);
+    void unlink(std::uint32_t index);
+    void release(std::uint32_t index);
+    void cascade(std::uint32_t level);
+};
+
+#endif // TIMERWHEEL_H
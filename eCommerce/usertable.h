@@ -0,0 +1,186 @@
+#ifndef USERTABLE_H
+#define USERTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "checksum.h"
+
+/**
+ * @brief Interns the usernames of one shard into dense integer IDs.
+ *
+ * Names are packed back to back in one buffer and found through an
+ * open-addressing table of IDs, so a user costs its name bytes plus about
+ * 16 bytes and a lookup is one hash and usually one comparison. IDs count
+ * up from 0 in interning order; the ID of an erased user is handed out
+ * again, so per-user state can live in plain vectors indexed by ID whose
+ * size follows the number of live users. The buffer is compacted once
+ * erased names make up half of it.
+ *
+ * The table uses its own hash rather than std::hash, which already decided
+ * the shard and would leave the low bits of every user in a shard equal.
+ */
+class UserTable {
+public:
+    using UserId = std::uint32_t;
+    static constexpr UserId NoUser = static_cast<UserId>(-1);
+
+    /**
+     * @return One more than the highest ID handed out; erased IDs included.
+     */
+    std::size_t size() const { return entries.size(); }
+    std::size_t liveCount() const { return entries.size() - freeIds.size(); }
+
+    bool contains(UserId id) const { return id < entries.size() && entries[id].offset != Erased; }
+
+    /**
+     * @return The name of the user; empty for an erased or unknown ID.
+     */
+    std::string_view name(UserId id) const
+    {
+        if (!contains(id)) {
+            return {};
+        }
+        return std::string_view(names.data() + entries[id].offset, entries[id].length);
+    }
+
+    /**
+     * @return The ID of the user, or NoUser if the name is not interned.
+     */
+    UserId find(std::string_view username) const
+    {
+        if (slots.empty()) {
+            return NoUser;
+        }
+        return slots[slotFor(username)];
+    }
+
+    /**
+     * @brief Returns the ID of the user, assigning a free one if needed.
+     *
+     * @throws std::length_error if the shard runs out of IDs or name space.
+     */
+    UserId intern(std::string_view username)
+    {
+        if ((liveCount() + 1) * 4 > slots.size() * 3) {
+            rehash(slots.empty() ? 16 : slots.size() * 2);
+        }
+        std::size_t slot = slotFor(username);
+        if (slots[slot] != NoUser) {
+            return slots[slot];
+        }
+        if (names.size() + username.size() > UINT32_MAX) {
+            compact();
+        }
+        if ((freeIds.empty() && size() >= NoUser - 1) || names.size() + username.size() > UINT32_MAX) {
+            throw std::length_error("Too many users in one shard.");
+        }
+
+        UserId id;
+        if (freeIds.empty()) {
+            id = static_cast<UserId>(entries.size());
+            entries.emplace_back();
+        } else {
+            id = freeIds.back();
+            freeIds.pop_back();
+        }
+        entries[id] = { static_cast<std::uint32_t>(names.size()), static_cast<std::uint32_t>(username.size()) };
+        names.append(username.data(), username.size());
+        slots[slot] = id;
+        return id;
+    }
+
+    /**
+     * @brief Forgets a user; its ID is the next one intern() hands out.
+     */
+    void erase(UserId id)
+    {
+        if (!contains(id)) {
+            return;
+        }
+        // Backward-shift deletion keeps every probe sequence unbroken
+        std::size_t mask = slots.size() - 1;
+        std::size_t hole = slotFor(name(id));
+        for (std::size_t slot = (hole + 1) & mask; slots[slot] != NoUser; slot = (slot + 1) & mask) {
+            std::size_t home = hash(name(slots[slot])) & mask;
+            if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+                slots[hole] = slots[slot];
+                hole = slot;
+            }
+        }
+        slots[hole] = NoUser;
+
+        erasedBytes += entries[id].length;
+        entries[id] = { Erased, 0 };
+        freeIds.push_back(id);
+        if (erasedBytes > names.size() / 2) {
+            compact();
+        }
+    }
+
+private:
+    static constexpr std::uint32_t Erased = static_cast<std::uint32_t>(-1);
+
+    struct Entry {
+        std::uint32_t offset = Erased;
+        std::uint32_t length = 0;
+    };
+
+    std::string names;
+    std::size_t erasedBytes = 0;
+    std::vector<Entry> entries;     // indexed by ID
+    std::vector<UserId> freeIds;
+    std::vector<UserId> slots;      // power-of-two sized, NoUser marks a free slot
+
+    static std::size_t hash(std::string_view username) { return fnv1a(username.data(), username.size()); }
+
+    // Linear probing: the slot holding the user, or the free slot it would go in
+    std::size_t slotFor(std::string_view username) const
+    {
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t slot = hash(username) & mask; ; slot = (slot + 1) & mask) {
+            if (slots[slot] == NoUser || name(slots[slot]) == username) {
+                return slot;
+            }
+        }
+    }
+
+    void rehash(std::size_t slotCount)
+    {
+        std::vector<UserId> rehashed(slotCount, NoUser);
+        std::size_t mask = rehashed.size() - 1;
+        for (UserId id = 0; id < size(); ++id) {
+            if (!contains(id)) {
+                continue;
+            }
+            std::size_t slot = hash(name(id)) & mask;
+            while (rehashed[slot] != NoUser) {
+                slot = (slot + 1) & mask;
+            }
+            rehashed[slot] = id;
+        }
+        slots.swap(rehashed);
+    }
+
+    // Drops the bytes of erased names; IDs and slots are unaffected
+    void compact()
+    {
+        std::string packed;
+        packed.reserve(names.size() - erasedBytes);
+        for (Entry& entry : entries) {
+            if (entry.offset != Erased) {
+                std::uint32_t offset = static_cast<std::uint32_t>(packed.size());
+                packed.append(names, entry.offset, entry.length);
+                entry.offset = offset;
+            }
+        }
+        names.swap(packed);
+        names.shrink_to_fit();
+        erasedBytes = 0;
+    }
+};
+
+#endif // USERTABLE_H
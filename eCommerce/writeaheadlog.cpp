@@ -0,0 +1,422 @@
+#include "writeaheadlog.h"
+#include "checksum.h"
+#include "loggingcategories.h"
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+namespace {
+
+constexpr char FileMagic[4] = { 'E', 'W', 'A', 'L' };
+constexpr std::uint32_t FileVersion = 1;
+constexpr std::size_t FileHeaderSize = 8;
+constexpr std::size_t RecordHeaderSize = 8;
+
+template <typename T>
+void appendRaw(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T readRaw(const char* data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Walks the intact records of a mapped log.
+ *
+ * visit gets the LSN, the fields (with the "eCommerce?" header segment put
+ * back in front) and the offset just past the record.
+ *
+ * @return The offset just past the last intact record.
+ */
+template <typename Function>
+std::size_t scanRecords(const char* data, std::size_t size, Function&& visit)
+{
+    std::uint64_t lastLsn = 0;
+    std::size_t offset = FileHeaderSize;
+    while (offset + RecordHeaderSize <= size)
+    {
+        std::uint32_t bodySize = readRaw<std::uint32_t>(data + offset);
+        std::uint32_t bodyChecksum = readRaw<std::uint32_t>(data + offset + 4);
+        const char* body = data + offset + RecordHeaderSize;
+        if (bodySize < 9 || offset + RecordHeaderSize + bodySize > size || fnv1a(body, bodySize) != bodyChecksum) {
+            break;
+        }
+
+        std::uint64_t lsn = readRaw<std::uint64_t>(body);
+        std::size_t fieldCount = static_cast<std::uint8_t>(body[8]);
+        MessageSegments fields;
+        fields.push_back("eCommerce?");
+        std::size_t fieldOffset = 9;
+        bool valid = fieldCount < MessageSegments::MaxSegments;
+        for (std::size_t i = 0; valid && i < fieldCount; ++i) {
+            if (fieldOffset + 2 > bodySize) {
+                valid = false;
+                break;
+            }
+            std::uint16_t fieldSize = readRaw<std::uint16_t>(body + fieldOffset);
+            fieldOffset += 2;
+            if (fieldOffset + fieldSize > bodySize) {
+                valid = false;
+                break;
+            }
+            fields.push_back(std::string_view(body + fieldOffset, fieldSize));
+            fieldOffset += fieldSize;
+        }
+        if (!valid || lsn <= lastLsn) {
+            break;
+        }
+
+        offset += RecordHeaderSize + bodySize;
+        visit(lsn, fields, offset);
+        lastLsn = lsn;
+    }
+    return offset;
+}
+
+std::string fileHeader()
+{
+    std::string header(FileMagic, sizeof(FileMagic));
+    appendRaw<std::uint32_t>(header, FileVersion);
+    return header;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog() = default;
+
+WriteAheadLog::~WriteAheadLog()
+{
+    close();
+}
+
+/**
+ * @brief Opens (or creates) the log, replays it and starts the writer thread.
+ *
+ * apply is called for every intact record in LSN order before any new
+ * record can be appended. New records are numbered after both the last
+ * record and baseLsn, the newest LSN a loaded snapshot already covers.
+ *
+ * @return The newest LSN in use: the last replayed record or baseLsn.
+ * @throws std::runtime_error if the file cannot be opened or is not a log.
+ */
+std::uint64_t WriteAheadLog::open(const std::string& path, SyncPolicy policy, std::chrono::milliseconds syncInterval,
+                                  const ReplayFunction& apply, std::uint64_t baseLsn)
+{
+    close();
+
+    file = std::make_unique<QFile>(QString::fromStdString(path));
+    if (!file->open(QIODevice::ReadWrite)) {
+        throw std::runtime_error("Cannot open write-ahead log " + path + ": " + file->errorString().toStdString());
+    }
+
+    std::uint64_t lastLsn = std::max(replayFile(apply), baseLsn);
+
+    this->policy = policy;
+    this->syncInterval = syncInterval;
+    nextLsn = lastLsn + 1;
+    durableLsn = lastLsn;
+    stopping = false;
+    pending.clear();
+    writerThread = std::thread(&WriteAheadLog::writerTask, this);
+    return lastLsn;
+}
+
+/**
+ * @brief Writes out everything appended so far and stops the writer thread.
+ */
+void WriteAheadLog::close()
+{
+    if (writerThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        pendingCondition.notify_one();
+        writerThread.join();
+    }
+    file.reset();
+}
+
+/**
+ * @brief The LSN of the most recently appended record, 0 if there is none.
+ */
+std::uint64_t WriteAheadLog::lastLsn()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return nextLsn - 1;
+}
+
+/**
+ * @brief Queues the segments from index first onwards as one record.
+ *
+ * @return The LSN assigned to the record.
+ */
+std::uint64_t WriteAheadLog::append(const MessageSegments& segments, std::size_t first)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::uint64_t lsn = nextLsn++;
+
+    std::size_t recordStart = pending.size();
+    appendRaw<std::uint32_t>(pending, 0);
+    appendRaw<std::uint32_t>(pending, 0);
+    appendRaw<std::uint64_t>(pending, lsn);
+    appendRaw<std::uint8_t>(pending, static_cast<std::uint8_t>(segments.size() - first));
+    for (std::size_t i = first; i < segments.size(); ++i) {
+        std::string_view field = segments[i].substr(0, UINT16_MAX);
+        appendRaw<std::uint16_t>(pending, static_cast<std::uint16_t>(field.size()));
+        pending.append(field.data(), field.size());
+    }
+
+    const char* body = pending.data() + recordStart + RecordHeaderSize;
+    std::uint32_t bodySize = static_cast<std::uint32_t>(pending.size() - recordStart - RecordHeaderSize);
+    std::uint32_t bodyChecksum = fnv1a(body, bodySize);
+    std::memcpy(&pending[recordStart], &bodySize, sizeof(bodySize));
+    std::memcpy(&pending[recordStart + 4], &bodyChecksum, sizeof(bodyChecksum));
+
+    pendingCondition.notify_one();
+    return lsn;
+}
+
+/**
+ * @brief Blocks until the record with the given LSN has been synced.
+ *
+ * Only the Batch policy promises durability before returning; with the
+ * other policies this returns immediately.
+ *
+ * @return false if the log has failed, so the record may not be on disk.
+ */
+bool WriteAheadLog::waitDurable(std::uint64_t lsn)
+{
+    if (policy != SyncPolicy::Batch) {
+        return !hasFailed();
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    durableCondition.wait(lock, [this, lsn] { return durableLsn >= lsn || stopping || hasFailed(); });
+    return durableLsn >= lsn;
+}
+
+/**
+ * @brief Asks the writer thread to drop all records up to and including lsn.
+ *
+ * Called once a snapshot covers those records. The log is rewritten to a
+ * new file and swapped in atomically, so a crash in between leaves either
+ * the old or the new log.
+ */
+void WriteAheadLog::truncate(std::uint64_t lsn)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    truncateLsn = std::max(truncateLsn, lsn);
+    pendingCondition.notify_one();
+}
+
+WriteAheadLog::SyncPolicy WriteAheadLog::parseSyncPolicy(const std::string& name)
+{
+    if (name == "batch") {
+        return SyncPolicy::Batch;
+    }
+    if (name == "periodic") {
+        return SyncPolicy::Periodic;
+    }
+    if (name == "none") {
+        return SyncPolicy::None;
+    }
+    throw std::invalid_argument("Unknown sync policy '" + name + "', expected batch, periodic or none.");
+}
+
+std::uint64_t WriteAheadLog::replayFile(const ReplayFunction& apply)
+{
+    qint64 fileSize = file->size();
+    if (fileSize < static_cast<qint64>(FileHeaderSize)) {
+        std::string header = fileHeader();
+        file->resize(0);
+        file->seek(0);
+        if (file->write(header.data(), static_cast<qint64>(header.size())) != static_cast<qint64>(header.size()) || !file->flush()) {
+            throw std::runtime_error("Cannot write the write-ahead log header: " + file->errorString().toStdString());
+        }
+        return 0;
+    }
+
+    const char* data = reinterpret_cast<const char*>(file->map(0, fileSize));
+    if (!data) {
+        throw std::runtime_error("Cannot map the write-ahead log: " + file->errorString().toStdString());
+    }
+    if (std::memcmp(data, FileMagic, sizeof(FileMagic)) != 0 || readRaw<std::uint32_t>(data + 4) != FileVersion) {
+        file->unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+        throw std::runtime_error("The write-ahead log has an unknown format.");
+    }
+
+    std::uint64_t lastLsn = 0;
+    std::size_t size = static_cast<std::size_t>(fileSize);
+    std::size_t offset = scanRecords(data, size, [&apply, &lastLsn](std::uint64_t lsn, const MessageSegments& fields, std::size_t) {
+        apply(lsn, fields);
+        lastLsn = lsn;
+    });
+
+    file->unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+    if (offset != size) {
+        qCWarning(ecommercelog) << "Discarding" << (size - offset) << "bytes of torn or corrupt write-ahead log records.";
+        file->resize(static_cast<qint64>(offset));
+    }
+    file->seek(static_cast<qint64>(offset));
+    return lastLsn;
+}
+
+void WriteAheadLog::writerTask()
+{
+    auto lastSync = std::chrono::steady_clock::now();
+    bool unsynced = false;
+    std::string batch;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        if (policy == SyncPolicy::Periodic && unsynced) {
+            pendingCondition.wait_until(lock, lastSync + syncInterval, [this] { return stopping || !pending.empty() || truncateLsn > 0; });
+        } else {
+            pendingCondition.wait(lock, [this] { return stopping || !pending.empty() || truncateLsn > 0; });
+        }
+        if (pending.empty() && stopping && !unsynced) {
+            break;
+        }
+
+        batch.clear();
+        batch.swap(pending);
+        std::uint64_t batchLsn = nextLsn - 1;
+        std::uint64_t compactLsn = truncateLsn;
+        truncateLsn = 0;
+        lock.unlock();
+
+        if (hasFailed()) {
+            // Nothing appended after a failure can be trusted to the file
+            unsynced = false;
+            lock.lock();
+            continue;
+        }
+
+        bool written = true;
+        if (!batch.empty()) {
+            if (file->write(batch.data(), static_cast<qint64>(batch.size())) != static_cast<qint64>(batch.size()) || !file->flush()) {
+                qCCritical(ecommercelog) << "Write-ahead log write failed:" << file->errorString();
+                written = false;
+            }
+            unsynced = true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        bool sync = policy == SyncPolicy::Batch
+                    || (policy == SyncPolicy::Periodic && (now - lastSync >= syncInterval || stopping));
+        if (written && unsynced && sync) {
+            written = syncToDisk();
+            lastSync = now;
+            unsynced = false;
+        }
+        if (policy == SyncPolicy::None) {
+            unsynced = false;
+        }
+        if (!written) {
+            fail();
+            lock.lock();
+            continue;
+        }
+        if (compactLsn > 0) {
+            compact(compactLsn);
+        }
+
+        lock.lock();
+        durableLsn = batchLsn;
+        durableCondition.notify_all();
+    }
+}
+
+bool WriteAheadLog::syncToDisk()
+{
+#ifndef _WIN32
+    int rc = ::fsync(file->handle());
+#else
+    int rc = ::_commit(file->handle());
+#endif
+    if (rc != 0) {
+        qCCritical(ecommercelog) << "Write-ahead log fsync failed.";
+    }
+    return rc == 0;
+}
+
+/**
+ * @brief Stops the log for good and wakes every command waiting on it.
+ *
+ * Called on the writer thread without the mutex held.
+ */
+void WriteAheadLog::fail()
+{
+    qCCritical(ecommercelog) << "The write-ahead log has failed; state-changing commands are rejected from now on.";
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed.store(true, std::memory_order_release);
+    }
+    durableCondition.notify_all();
+}
+
+/**
+ * @brief Rewrites the log without the records up to and including lsn.
+ *
+ * Runs on the writer thread between batches, so nothing else touches the
+ * file meanwhile.
+ */
+void WriteAheadLog::compact(std::uint64_t lsn)
+{
+    if (!file->flush()) {
+        return;
+    }
+    qint64 fileSize = file->size();
+    const char* data = reinterpret_cast<const char*>(file->map(0, fileSize));
+    if (!data) {
+        qCWarning(ecommercelog) << "Cannot map the write-ahead log for truncation:" << file->errorString();
+        return;
+    }
+
+    std::size_t size = static_cast<std::size_t>(fileSize);
+    std::size_t keepFrom = FileHeaderSize;
+    std::size_t end = scanRecords(data, size, [lsn, &keepFrom](std::uint64_t recordLsn, const MessageSegments&, std::size_t recordEnd) {
+        if (recordLsn <= lsn) {
+            keepFrom = recordEnd;
+        }
+    });
+    if (keepFrom == FileHeaderSize) {
+        file->unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+        return;
+    }
+
+    QString path = file->fileName();
+    QSaveFile out(path);
+    std::string header = fileHeader();
+    bool written = out.open(QIODevice::WriteOnly)
+                   && out.write(header.data(), static_cast<qint64>(header.size())) == static_cast<qint64>(header.size())
+                   && out.write(data + keepFrom, static_cast<qint64>(end - keepFrom)) == static_cast<qint64>(end - keepFrom);
+    file->unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+
+    // The replacement is renamed over the open log, which Windows refuses
+    file->close();
+    if (!written || !out.commit()) {
+        qCWarning(ecommercelog) << "Cannot truncate the write-ahead log:" << out.errorString();
+    } else {
+        qCInfo(ecommercelog) << "Truncated" << (keepFrom - FileHeaderSize) << "bytes of write-ahead log records up to LSN" << lsn;
+    }
+    if (!file->open(QIODevice::ReadWrite)) {
+        qCCritical(ecommercelog) << "Cannot reopen the write-ahead log:" << file->errorString();
+        return;
+    }
+    file->seek(file->size());
+}
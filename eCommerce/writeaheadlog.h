@@ -0,0 +1,94 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "messagetokenizer.h"
+
+class QFile;
+
+/**
+ * @brief Append-only binary log of state-changing commands.
+ *
+ * Worker threads append the segments of a command and get back its log
+ * sequence number (LSN). A single writer thread drains everything appended
+ * since its last wakeup, writes it in one go and syncs it to disk according
+ * to the sync policy, so concurrent commands share one fsync (group commit).
+ *
+ * File layout, in host byte order: an 8-byte file header ("EWAL" and a
+ * version), then records of
+ *
+ *   std::uint32_t bodySize
+ *   std::uint32_t checksum        FNV-1a of the body
+ *   std::uint64_t lsn             body starts here
+ *   std::uint8_t  fieldCount
+ *   fieldCount x { std::uint16_t size; char data[size]; }
+ *
+ * open() replays the existing records before accepting new ones. A torn or
+ * corrupt record ends replay and is cut off together with anything after it.
+ * truncate() drops the records a snapshot has made redundant.
+ *
+ * A failed write or sync leaves the file in an unknown state, so the log
+ * then stops writing for good: durableLsn no longer moves and waitDurable()
+ * reports the failure to every waiting and later command.
+ */
+class WriteAheadLog {
+public:
+    enum class SyncPolicy {
+        Batch,      // fsync every batch; waitDurable() waits for it
+        Periodic,   // fsync at most once per sync interval
+        None        // leave flushing to the operating system
+    };
+
+    using ReplayFunction = std::function<void(std::uint64_t lsn, const MessageSegments& fields)>;
+
+    WriteAheadLog();
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    std::uint64_t open(const std::string& path, SyncPolicy policy, std::chrono::milliseconds syncInterval,
+                       const ReplayFunction& apply, std::uint64_t baseLsn = 0);
+    void close();
+    bool isOpen() const { return writerThread.joinable(); }
+    SyncPolicy syncPolicy() const { return policy; }
+
+    std::uint64_t append(const MessageSegments& segments, std::size_t first);
+    std::uint64_t lastLsn();
+    bool waitDurable(std::uint64_t lsn);
+    bool hasFailed() const { return failed.load(std::memory_order_acquire); }
+    void truncate(std::uint64_t lsn);
+
+    static SyncPolicy parseSyncPolicy(const std::string& name);
+
+private:
+    std::unique_ptr<QFile> file;
+    SyncPolicy policy = SyncPolicy::Batch;
+    std::chrono::milliseconds syncInterval{1000};
+
+    std::mutex mutex;
+    std::condition_variable pendingCondition;
+    std::condition_variable durableCondition;
+    std::string pending;
+    std::uint64_t nextLsn = 1;
+    std::uint64_t durableLsn = 0;
+    std::uint64_t truncateLsn = 0;
+    bool stopping = false;
+    std::atomic<bool> failed{false};
+    std::thread writerThread;
+
+    std::uint64_t replayFile(const ReplayFunction& apply);
+    void writerTask();
+    bool syncToDisk();
+    void fail();
+    void compact(std::uint64_t lsn);
+};
+
+#endif // WRITEAHEADLOG_H